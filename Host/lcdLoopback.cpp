@@ -0,0 +1,128 @@
+// The display module's firmware on the host (see lcdLoopback.h)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lcdLoopback.h"
+
+#define CELLS 32   // the Sim's lcd model is 16x2
+
+extern "C" void simServe(int in, int out, int khz);   // Sim/master.c, never returns
+
+
+LcdLoopback::LcdLoopback(int khz)
+   : stale(true), caughtUp(false), curText(CELLS, ' '), lcdText(CELLS, ' '),
+     inputCursor(0), busBytes(0), busTransactions(0) {
+   int down[2], up[2];
+
+   if (pipe(down) != 0 || pipe(up) != 0) {
+      perror("LcdLoopback: pipe");
+      exit(2);
+   }
+   fflush(stdout);   // or the child prints it again
+   pid=fork();
+   if (pid < 0) {
+      perror("LcdLoopback: fork");
+      exit(2);
+   }
+   if (pid == 0) {
+      close(down[1]);
+      close(up[0]);
+      simServe(down[0], up[1], khz);
+   }
+
+   close(down[0]);
+   close(up[1]);
+   toModule=down[1];
+   fromModule=up[0];
+}
+
+
+// closing the pipe ends the child
+LcdLoopback::~LcdLoopback() {
+   close(toModule);
+   close(fromModule);
+   waitpid(pid, NULL, 0);
+}
+
+
+// op and count byte, then len bytes of data
+void LcdLoopback::request(uint8_t op, int n, const uint8_t *data, int len) {
+   uint8_t head[2]={op, (uint8_t)n};
+
+   if (::write(toModule, head, 2) != 2
+       || (len > 0 && ::write(toModule, data, len) != len)) {
+      fprintf(stderr, "LcdLoopback: the module has gone\n");
+      exit(2);
+   }
+}
+
+
+void LcdLoopback::reply(uint8_t *data, int len) const {
+   int n;
+
+   while (len > 0) {
+      n=::read(fromModule, data, len);
+      if (n <= 0) {
+         fprintf(stderr, "LcdLoopback: the module has gone\n");
+         exit(2);
+      }
+      data+=n;
+      len-=n;
+   }
+}
+
+
+bool LcdLoopback::write(const uint8_t *data, int len) {
+   uint8_t status[2];
+
+   busBytes+=1+len;
+   busTransactions++;
+   stale=true;
+
+   request('W', len, data, len);
+   reply(status, 2);
+   return(status[0] != 0);
+}
+
+
+bool LcdLoopback::read(uint8_t *data, int len) {
+   uint8_t status[2];
+
+   busBytes+=1+len;
+   busTransactions++;
+   stale=true;
+
+   request('R', len);
+   reply(status, 2);
+   reply(data, status[1]);
+   return(status[0] != 0 && status[1] == len);
+}
+
+
+void LcdLoopback::setInput(int ch, int counts) {
+   uint8_t value[2]={(uint8_t)(counts >> 8), (uint8_t)counts};
+   uint8_t status[2];
+
+   stale=true;
+   request('A', ch, value, 2);
+   reply(status, 2);
+}
+
+
+// lets the firmware catch up and fetches what it shows
+void LcdLoopback::settle() const {
+   uint8_t state[2+2*CELLS];
+
+   if (!stale)
+      return;
+   stale=false;
+
+   const_cast<LcdLoopback *>(this)->request('S', 0);
+   reply(state, sizeof(state));
+   caughtUp=state[0] != 0;
+   curText.assign((const char *)state+1, CELLS);
+   lcdText.assign((const char *)state+1+CELLS, CELLS);
+   inputCursor=state[1+2*CELLS];
+}
@@ -0,0 +1,58 @@
+// The display module's firmware on the host, to try masters offline
+//
+// Each LcdLoopback runs the firmware as compiled by ../Sim, with its lcd
+// model, in a child process of its own (simServe() in Sim/master.c), so
+// several modules can be compared side by side. write() and read() are
+// i2c transactions at khz, clock stretching included. The firmware
+// keeps running in simulated time between them.
+//
+// panel() is what the lcd shows and screen() is curText, once the
+// firmware has caught up with the transactions so far: its queue is
+// empty and the screen is drawn, or a frame is open.
+
+#ifndef LCD_LOOPBACK_H
+#define LCD_LOOPBACK_H
+
+#include "lcdMaster.h"
+
+class LcdLoopback : public LcdBus {
+public:
+   LcdLoopback(int khz=100);
+   ~LcdLoopback();
+
+   bool write(const uint8_t *data, int len);
+   bool read(uint8_t *data, int len);
+
+   // MCP3208 input ch (0-7) from now on, 0-4095
+   void setInput(int ch, int counts);
+
+   const std::string &screen() const { settle(); return(curText); }
+   const std::string &panel() const { settle(); return(lcdText); }
+   int cursor() const { settle(); return(inputCursor); }
+   bool settled() const { settle(); return(caughtUp); }
+
+   long bytes() const { return(busBytes); }             // addresses included
+   long transactions() const { return(busTransactions); }
+
+private:
+   LcdLoopback(const LcdLoopback &);
+   LcdLoopback &operator=(const LcdLoopback &);
+
+   void request(uint8_t op, int n, const uint8_t *data=NULL, int len=0);
+   void reply(uint8_t *data, int len) const;
+   void settle() const;
+
+   int toModule, fromModule;   // pipes to the child
+   int pid;
+
+   mutable bool stale;         // transactions since the last settle()
+   mutable bool caughtUp;
+   mutable std::string curText;
+   mutable std::string lcdText;
+   mutable int inputCursor;
+
+   long busBytes;
+   long busTransactions;
+};
+
+#endif
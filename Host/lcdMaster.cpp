@@ -0,0 +1,268 @@
+// Host side master for the lcd display module (see lcdMaster.h)
+
+#include <stdio.h>
+#include <string.h>
+#include "lcdMaster.h"
+
+#define ISR_BYTE_US  18.0    // ssp_interrupt() per byte at 20 MHz, measured in Sim/
+
+// how a run of cells is sent
+enum { RUN_REGION, RUN_LONG_TEXT, RUN_SHORT_TEXT };
+
+
+LcdCost::LcdCost(int hz) {
+   byteUs=9e6/hz;
+   isrByteUs=ISR_BYTE_US;
+   startUs=2e6/hz+byteUs+isrByteUs;   // start and stop take about a clock each
+}
+
+
+LcdMaster::LcdMaster(LcdBus &bus, int cells)
+   : bus(bus), atomic(false), cells(cells),
+     totalBytes(0), totalTransactions(0), totalUs(0) {
+   forget();
+}
+
+
+// nothing is known about the module until clear() or sync()
+void LcdMaster::forget() {
+   shadowText.assign(cells, ' ');
+   shadowKnown.assign(cells, false);
+   inputCursor=-1;
+}
+
+
+bool LcdMaster::transfer(const uint8_t *data, int len, uint8_t *reply, int replyLen) {
+   totalBytes+=1+len;
+   totalTransactions++;
+   totalUs+=cost.transaction(len);
+   if (!bus.write(data, len))
+      return(false);
+   if (replyLen == 0)
+      return(true);
+
+   totalBytes+=1+replyLen;
+   totalTransactions++;
+   totalUs+=cost.transaction(replyLen);
+   return(bus.read(reply, replyLen));
+}
+
+
+// nothing is sent when a command of the plan could not be encoded
+bool LcdMaster::send(const Plan &plan) {
+   size_t i;
+
+   for (i=0;i<plan.size();i++) {
+      if (plan[i].empty())
+         return(false);
+   }
+   for (i=0;i<plan.size();i++) {
+      if (!transfer(&plan[i][0], plan[i].size(), NULL, 0))
+         return(false);
+   }
+   return(true);
+}
+
+
+bool LcdMaster::connect() {
+   uint8_t view[3]={LCD_REG_ACCESS, LCD_REG_VIEW, LCD_VIEW_TEXT};
+
+   forget();
+   if (!transfer(view, 3, NULL, 0))
+      return(false);
+   return(sync());
+}
+
+
+bool LcdMaster::clear() {
+   uint8_t code=LCD_CLEAR;
+
+   if (!transfer(&code, 1, NULL, 0)) {
+      forget();
+      return(false);
+   }
+   shadowText.assign(cells, ' ');
+   shadowKnown.assign(cells, true);
+   inputCursor=0;
+   return(true);
+}
+
+
+bool LcdMaster::sync() {
+   uint8_t select[2]={LCD_REG_ACCESS, 0x00};   // register 0x00: first screen cell
+   uint8_t text[LCD_SCREEN_SIZE];
+   uint8_t code=LCD_GETPOS, pos;
+   int i, n;
+
+   forget();
+   n=cells < LCD_SCREEN_SIZE ? cells : LCD_SCREEN_SIZE;
+   if (!transfer(select, 2, text, n))
+      return(false);
+   if (!transfer(&code, 1, &pos, 1))
+      return(false);
+
+   for (i=0;i<n;i++) {
+      shadowText[i]=text[i];
+      shadowKnown[i]=true;
+   }
+   inputCursor=pos;
+   return(true);
+}
+
+
+bool LcdMaster::changed(const std::string &to, int pos, bool afterClear) const {
+   if (afterClear)
+      return(to[pos] != ' ');
+   return(!shadowKnown[pos] || shadowText[pos] != to[pos]);
+}
+
+
+// a command that cannot be encoded is added empty, send() refuses it
+void LcdMaster::addCommand(Plan *plan, uint8_t code, const uint8_t *args, int nargs,
+                           const uint8_t *payload, int len) const {
+   std::vector<uint8_t> out(len+LCD_MAX_ARGS+3);
+   int n;
+
+   n=lcdEncode(&out[0], out.size(), code, args, nargs, payload, len);
+   if (n < 0) {
+      fprintf(stderr, "LcdMaster: cannot encode command %d (%d bytes)\n", code, len);
+      n=0;
+   }
+   out.resize(n);
+   plan->push_back(out);
+}
+
+
+// Cheapest way to write to[start..end) when the input cursor is at
+// atCursor. Adds the commands to plan when it is not NULL.
+double LcdMaster::runCost(const std::string &to, int start, int end, int atCursor, Plan *plan) const {
+   const uint8_t *text;
+   uint8_t arg;
+   double best, jump, c;
+   int n, how;
+
+   n=end-start;
+   text=(const uint8_t *)to.data()+start;
+   jump=atCursor == start ? 0 : cost.transaction(2);   // SETPOS
+
+   how=RUN_REGION;
+   best=cost.transaction(3+n);
+
+   c=jump+cost.transaction(2+n);
+   if (memchr(text, '\0', n) == NULL && c < best) {    // a NUL would end the text
+      how=RUN_LONG_TEXT;
+      best=c;
+   }
+   c=jump+cost.transaction(5);
+   if (n == 4 && c < best) {
+      how=RUN_SHORT_TEXT;
+      best=c;
+   }
+
+   if (plan == NULL)
+      return(best);
+
+   if (how == RUN_REGION) {
+      arg=start;
+      addCommand(plan, LCD_WRITE_REGION, &arg, 1, text, n);
+      return(best);
+   }
+   if (atCursor != start) {
+      arg=start+1;    // SETPOS counts from 1
+      addCommand(plan, LCD_SETPOS, &arg, 1, NULL, 0);
+   }
+   if (how == RUN_LONG_TEXT)
+      addCommand(plan, LCD_DISPLAY_LONG_TEXT, NULL, 0, text, n);
+   else
+      addCommand(plan, LCD_DISPLAY_SHORT_TEXT, text, 4, NULL, 0);
+   return(best);
+}
+
+
+// Splits the changed cells into runs at the lowest total cost. The cells
+// between two changed ones are rewritten when that is cheaper than
+// starting a new run. Every command leaves the input cursor just behind
+// what it wrote, so the cursor at the start of a run is known.
+double LcdMaster::planRuns(const std::string &to, bool afterClear, int &endCursor, Plan *plan) const {
+   std::vector<int> dirty, from;
+   std::vector<double> best;
+   std::vector<int> runs;
+   int startCursor, at, i, j, k, m;
+   double c;
+
+   for (i=0;i<cells;i++) {
+      if (changed(to, i, afterClear))
+         dirty.push_back(i);
+   }
+   m=dirty.size();
+   startCursor=afterClear ? 0 : inputCursor;
+
+   // best[k]: cheapest way to write the first k changed cells, the last
+   // run starting at changed cell from[k]
+   best.assign(m+1, 0);
+   from.assign(m+1, 0);
+   for (k=1;k<=m;k++) {
+      for (j=0;j<k;j++) {
+         at=j == 0 ? startCursor : (dirty[j-1]+1)%cells;
+         c=best[j]+runCost(to, dirty[j], dirty[k-1]+1, at, NULL);
+         if (j == 0 || c < best[k]) {
+            best[k]=c;
+            from[k]=j;
+         }
+      }
+   }
+
+   endCursor=m == 0 ? startCursor : (dirty[m-1]+1)%cells;
+   if (plan == NULL)
+      return(best[m]);
+
+   for (k=m;k>0;k=from[k])
+      runs.push_back(k);
+   for (i=runs.size()-1;i>=0;i--) {
+      k=runs[i];
+      j=from[k];
+      at=j == 0 ? startCursor : (dirty[j-1]+1)%cells;
+      runCost(to, dirty[j], dirty[k-1]+1, at, plan);
+   }
+   return(best[m]);
+}
+
+
+bool LcdMaster::show(const std::string &frame) {
+   std::string to(frame);
+   uint8_t code;
+   int endCursor, clearCursor;
+   double keep, redo;
+   bool useClear;
+   Plan plan;
+
+   to.resize(cells, ' ');
+
+   keep=planRuns(to, false, endCursor, NULL);
+   redo=cost.transaction(1)+planRuns(to, true, clearCursor, NULL);
+   useClear=redo < keep;
+
+   if (useClear) {
+      code=LCD_CLEAR;
+      addCommand(&plan, code, NULL, 0, NULL, 0);
+   }
+   planRuns(to, useClear, endCursor, &plan);
+   if (plan.empty())
+      return(true);
+
+   if (atomic && plan.size() > 1) {
+      code=LCD_BEGIN_FRAME;
+      plan.insert(plan.begin(), std::vector<uint8_t>(1, code));
+      code=LCD_COMMIT_FRAME;
+      plan.push_back(std::vector<uint8_t>(1, code));
+   }
+
+   if (!send(plan)) {
+      forget();
+      return(false);
+   }
+   shadowText=to;
+   shadowKnown.assign(cells, true);
+   inputCursor=endCursor;
+   return(true);
+}
@@ -0,0 +1,107 @@
+// Host side master for the lcd display module
+//
+// LcdMaster keeps a shadow of the module's screen buffer (curText) and of
+// its input cursor. show() takes a whole new frame and only sends what
+// differs from the shadow. For every changed run it picks the cheapest
+// way to get it there: WRITE_REGION, DISPLAY_LONG_TEXT or
+// DISPLAY_SHORT_TEXT at the input cursor, the same after a SETPOS, or a
+// CLEAR first when most of the screen goes blank. Runs separated by a
+// few unchanged cells are merged when one transaction costs less than
+// two. The costs come from LcdCost.
+//
+// The bus itself is reached through LcdBus, so the same code drives a
+// Linux i2c-dev adapter, a gogo bridge or the model in lcdLoopback.h.
+
+#ifndef LCD_MASTER_H
+#define LCD_MASTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "lcdProtocol.h"
+
+// i2c transactions with the module (the address is added by the bus).
+// Both return false when the module did not answer.
+class LcdBus {
+public:
+   virtual ~LcdBus() {}
+   virtual bool write(const uint8_t *data, int len)=0;
+   virtual bool read(uint8_t *data, int len)=0;
+};
+
+
+// What a write transaction costs, in microseconds
+struct LcdCost {
+   double startUs;     // start, address byte and stop
+   double byteUs;      // one byte with its ack (9 clocks)
+   double isrByteUs;   // SCL held while ssp_interrupt() handles the byte
+
+   LcdCost(int hz=100000);
+
+   double transaction(int bytes) const {
+      return(startUs+bytes*(byteUs+isrByteUs));
+   }
+};
+
+
+class LcdMaster {
+public:
+   LcdMaster(LcdBus &bus, int cells=LCD_SCREEN_SIZE);
+
+   void setCost(const LcdCost &cost) { this->cost=cost; }
+
+   // wrap updates that take more than one transaction in
+   // BEGIN_FRAME / COMMIT_FRAME, so the screen never shows half of one
+   void setAtomic(bool on) { atomic=on; }
+
+   // selects VIEW_TEXT, so the module shows only what is sent to it, and
+   // reads the screen back with sync()
+   bool connect();
+
+   bool clear();
+
+   // reads the screen registers and the cursor back from the module.
+   // Only the first 32 cells can be read, the others stay unknown.
+   bool sync();
+
+   // the frame holds the cells row after row. A shorter frame is padded
+   // with spaces, a longer one is cut. False when the module did not
+   // answer or a command could not be encoded.
+   bool show(const std::string &frame);
+
+   const std::string &shadow() const { return(shadowText); }
+   int cursor() const { return(inputCursor); }
+
+   // bus use so far: bytes (addresses included), transactions, and
+   // their estimated time
+   long busBytes() const { return(totalBytes); }
+   long transactions() const { return(totalTransactions); }
+   double busUs() const { return(totalUs); }
+
+private:
+   typedef std::vector<std::vector<uint8_t> > Plan;
+
+   double planRuns(const std::string &to, bool afterClear, int &endCursor, Plan *plan) const;
+   double runCost(const std::string &to, int start, int end, int atCursor, Plan *plan) const;
+   bool changed(const std::string &to, int pos, bool afterClear) const;
+   void addCommand(Plan *plan, uint8_t code, const uint8_t *args, int nargs,
+                   const uint8_t *payload, int len) const;
+   bool send(const Plan &plan);
+   bool transfer(const uint8_t *data, int len, uint8_t *reply, int replyLen);
+   void forget();
+
+   LcdBus &bus;
+   LcdCost cost;
+   bool atomic;
+   int cells;
+
+   std::string shadowText;           // the module's curText as far as we know
+   std::vector<bool> shadowKnown;
+   int inputCursor;                  // -1 when unknown
+
+   long totalBytes;
+   long totalTransactions;
+   double totalUs;
+};
+
+#endif
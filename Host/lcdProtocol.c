@@ -0,0 +1,131 @@
+// Host side encoder for the i2c protocol of the lcd display module
+// (see lcdProtocol.h)
+
+#include <string.h>
+#include "lcdProtocol.h"
+
+const LcdCommand lcdCommands[]={
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd) \
+   { #name, code, nargs, payload, bcast },
+#include "protocol.def"
+#undef PROTOCOL_COMMAND
+};
+
+const int lcdNumCommands=sizeof(lcdCommands)/sizeof(lcdCommands[0]);
+
+
+const LcdCommand *lcdFindCommand(uint8_t code) {
+   int i;
+
+   for (i=0;i<lcdNumCommands;i++) {
+      if (lcdCommands[i].code == code)
+         return(&lcdCommands[i]);
+   }
+   return(NULL);
+}
+
+
+int lcdEncode(uint8_t *out, int size, uint8_t code, const uint8_t *args, int nargs,
+              const uint8_t *payload, int len) {
+   const LcdCommand *cmd;
+   int n, wantArgs;
+
+   cmd=lcdFindCommand(code);
+   if (cmd == NULL || len < 0)
+      return(-1);
+
+   wantArgs=cmd->args;
+   if (cmd->payload == PAYLOAD_LENGTH)
+      wantArgs--;
+   if (nargs != wantArgs)
+      return(-1);
+
+   switch (cmd->payload) {
+      case PAYLOAD_NONE:
+         if (len != 0)
+            return(-1);
+         break;
+      case PAYLOAD_NUL:
+         if (payload != NULL && memchr(payload, '\0', len) != NULL)
+            return(-1);
+         break;
+      case PAYLOAD_LENGTH:
+         if (len > 255)
+            return(-1);
+         break;
+   }
+
+   n=1+cmd->args+len+(cmd->payload == PAYLOAD_NUL);
+   if (n > size)
+      return(-1);
+
+   n=0;
+   out[n++]=code;
+   if (nargs > 0) {
+      memcpy(out+n, args, nargs);
+      n+=nargs;
+   }
+   if (cmd->payload == PAYLOAD_LENGTH)
+      out[n++]=len;
+   if (len > 0) {
+      memcpy(out+n, payload, len);
+      n+=len;
+   }
+   if (cmd->payload == PAYLOAD_NUL)
+      out[n++]='\0';
+   return(n);
+}
+
+
+int lcdEncodeGeneralCall(uint8_t *out, int size, int group, uint8_t code, const uint8_t *args,
+                         int nargs, const uint8_t *payload, int len) {
+   const LcdCommand *cmd;
+   int n;
+
+   cmd=lcdFindCommand(code);
+   if (cmd == NULL || !cmd->broadcast || group < 0 || group > 127 || size < 1)
+      return(-1);
+
+   out[0]=(group << 1) | 1;
+   n=lcdEncode(out+1, size-1, code, args, nargs, payload, len);
+   if (n < 0)
+      return(-1);
+   return(n+1);
+}
+
+
+int lcdEncodeRegion(uint8_t *out, int size, int pos, const char *text, int len) {
+   uint8_t offset;
+
+   if (pos < 0 || pos >= LCD_SCREEN_SIZE || len > LCD_SCREEN_SIZE-pos)
+      return(-1);
+   offset=pos;
+   return(lcdEncode(out, size, LCD_WRITE_REGION, &offset, 1, (const uint8_t *)text, len));
+}
+
+
+int lcdEncodeSensors(uint8_t *out, int size, uint8_t mask, const uint16_t values[8]) {
+   uint8_t packed[10];
+   uint32_t bits;
+   int i, have, n;
+
+   bits=0;
+   have=0;
+   n=0;
+   for (i=0;i<8;i++) {
+      if (!(mask & (1 << i)))
+         continue;
+      if (values[i] > 1023)
+         return(-1);
+      bits=(bits << 10) | values[i];
+      have+=10;
+      while (have >= 8) {
+         have-=8;
+         packed[n++]=bits >> have;
+      }
+   }
+   if (have > 0)
+      packed[n++]=bits << (8-have);
+
+   return(lcdEncode(out, size, LCD_SENSOR_FRAME, &mask, 1, packed, n));
+}
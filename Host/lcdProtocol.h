@@ -0,0 +1,77 @@
+// Host side encoder for the i2c protocol of the lcd display module
+//
+// The commands come from Source/protocol.def, the same description the
+// firmware dispatcher is generated from, so both ends always agree on the
+// command codes and their arguments. Build with -I<path to Source>.
+//
+// lcdEncode() builds the bytes of one write transaction (without the
+// i2c address), ready to be sent by whatever i2c master is used.
+
+#ifndef LCD_PROTOCOL_H
+#define LCD_PROTOCOL_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// command codes: LCD_CLEAR, LCD_WRITE_REGION, ...
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd)  LCD_##name=code,
+enum {
+#include "protocol.def"
+   LCD_CODES_END
+};
+#undef PROTOCOL_COMMAND
+
+#define LCD_MAX_ARGS     4
+#define LCD_SCREEN_SIZE  32
+
+// view mode register (see Source/registers.c). The module starts up with
+// the ADC dashboard, which overwrites the text as the inputs change.
+#define LCD_REG_VIEW     0x44
+#define LCD_VIEW_TEXT    0
+
+typedef struct {
+   const char *name;
+   uint8_t code;
+   uint8_t args;       // fixed argument bytes
+   uint8_t payload;    // PAYLOAD_xxx
+   uint8_t broadcast;  // accepted from a general call
+} LcdCommand;
+
+extern const LcdCommand lcdCommands[];
+extern const int lcdNumCommands;
+
+// NULL for an unknown code
+const LcdCommand *lcdFindCommand(uint8_t code);
+
+// Encodes one command into out[size] and returns the number of bytes, or
+// -1 if the arguments do not match protocol.def or out is too small.
+//    args, nargs      the fixed arguments. For a PAYLOAD_LENGTH command
+//                     leave out the last one, the length is filled in.
+//    payload, len     the payload (NULL, 0 when there is none). The NUL
+//                     of a PAYLOAD_NUL command is added, the payload itself
+//                     may not contain one.
+int lcdEncode(uint8_t *out, int size, uint8_t code, const uint8_t *args, int nargs,
+              const uint8_t *payload, int len);
+
+// The same for a general call, to be sent to i2c address 0: the group
+// byte ((group << 1) | 1) and then the command. Group 0 reaches every
+// module, 1-127 the modules whose register 0x4A is set to it. -1 for a
+// command that is not accepted from a general call.
+int lcdEncodeGeneralCall(uint8_t *out, int size, int group, uint8_t code, const uint8_t *args,
+                         int nargs, const uint8_t *payload, int len);
+
+// WRITE_REGION: len characters at screen position pos (0-31)
+int lcdEncodeRegion(uint8_t *out, int size, int pos, const char *text, int len);
+
+// SENSOR_FRAME: values[port] (0-1023) of the sensors whose bit is set in
+// mask, packed 10 bits each. Sensors not in mask show 1023.
+int lcdEncodeSensors(uint8_t *out, int size, uint8_t mask, const uint16_t values[8]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,207 @@
+// Measures what LcdMaster saves on the bus, offline
+//
+//    lcdbench [-k kHz] [-f frames] [-a] [-v]
+//
+//       -k  bus clock in kHz (default 100)
+//       -f  frames per scenario (default 500)
+//       -a  atomic updates (BEGIN_FRAME / COMMIT_FRAME)
+//       -v  print every frame and the commands sent for it
+//
+// Every scenario produces a sequence of 16x2 frames. Each frame is sent
+// twice, to two LcdLoopback modules (the firmware, run by the Sim): once
+// the way the gogo board does it now (SETPOS 1 and the whole screen as
+// DISPLAY_LONG_TEXT) and once through LcdMaster::show(). Both panels must
+// end up showing the frame, while the module's ADC inputs keep changing
+// underneath. Exits with 1 when one does not.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lcdLoopback.h"
+
+#define COLS 16
+
+
+// passes the transactions on and adds up their bytes and time
+class CountingBus : public LcdBus {
+public:
+   CountingBus(LcdBus &bus, const LcdCost &cost, bool verbose)
+      : bus(bus), cost(cost), verbose(verbose), bytes(0), us(0) {}
+
+   bool write(const uint8_t *data, int len) {
+      count(len);
+      if (verbose) {
+         const LcdCommand *cmd=lcdFindCommand(data[0]);
+         printf("   %-22s", cmd ? cmd->name : "?");
+         for (int i=1;i<len;i++)
+            printf(" %02X", data[i]);
+         printf("\n");
+      }
+      return(bus.write(data, len));
+   }
+
+   bool read(uint8_t *data, int len) {
+      count(len);
+      return(bus.read(data, len));
+   }
+
+   LcdBus &bus;
+   LcdCost cost;
+   bool verbose;
+   long bytes;
+   double us;
+
+private:
+   void count(int len) {
+      bytes+=1+len;
+      us+=cost.transaction(len);
+   }
+};
+
+
+static int frames=500;
+static int khz=100;
+static bool atomic=false;
+static bool verbose=false;
+static int failures=0;
+
+
+static void makeFrame(char *frame, const char *row0, const char *row1) {
+   snprintf(frame, 2*COLS+1, "%-16.16s%-16.16s", row0, row1);
+}
+
+
+// a counter and a slowly changing reading
+static void counterFrame(int n, char *frame) {
+   char row0[COLS+1], row1[COLS+1];
+
+   snprintf(row0, sizeof(row0), "Count: %5d", n);
+   snprintf(row1, sizeof(row1), "Light %4d", 500+(n/7)%300);
+   makeFrame(frame, row0, row1);
+}
+
+
+// four sensors wandering a few counts per frame
+static void dashboardFrame(int n, char *frame) {
+   static int value[4]={100, 2000, 3000, 4000};
+   char row0[COLS+1], row1[COLS+1];
+   int i;
+
+   for (i=0;i<4;i++) {
+      value[i]+=rand()%7-3;
+      if (value[i] < 0) value[i]=0;
+      if (value[i] > 4095) value[i]=4095;
+   }
+   snprintf(row0, sizeof(row0), "A0=%04d  A1=%04d", value[0], value[1]);
+   snprintf(row1, sizeof(row1), "A2=%04d  A3=%04d", value[2], value[3]);
+   makeFrame(frame, row0, row1);
+}
+
+
+// a menu flipping between pages, one of them nearly blank
+static void pagesFrame(int n, char *frame) {
+   static const char *page[3][2]={
+      { "Main menu", "> Sensors" },
+      { "Main menu", "> Motors" },
+      { "", "   Done" }};
+   int p;
+
+   p=(n/5)%3;
+   makeFrame(frame, page[p][0], page[p][1]);
+}
+
+
+// nothing stays the same: the worst case for diffing
+static void randomFrame(int n, char *frame) {
+   int i;
+
+   for (i=0;i<2*COLS;i++)
+      frame[i]='!'+rand()%90;
+   frame[2*COLS]='\0';
+}
+
+
+static void runScenario(const char *name, void (*next)(int, char *)) {
+   LcdCost cost(khz*1000);
+   LcdLoopback naiveModule(khz), diffModule(khz);
+   CountingBus naiveBus(naiveModule, cost, false);
+   CountingBus diffBus(diffModule, cost, verbose);
+   LcdMaster master(diffBus);
+   uint8_t out[64];
+   uint8_t view[3]={LCD_REG_ACCESS, LCD_REG_VIEW, LCD_VIEW_TEXT};
+   uint8_t arg=1;
+   char frame[2*COLS+1];
+   int i, n;
+
+   // the setup is not counted
+   naiveBus.write(view, 3);
+   master.setCost(cost);
+   master.setAtomic(atomic);
+   master.connect();
+   master.clear();
+   naiveBus.bytes=diffBus.bytes=0;
+   naiveBus.us=diffBus.us=0;
+   srand(1);
+
+   for (i=0;i<frames;i++) {
+      next(i, frame);
+      if (verbose)
+         printf("%s %d: \"%s\"\n", name, i, frame);
+
+      // the inputs keep moving, a dashboard would show them
+      naiveModule.setInput(i%4, i*397%4096);
+      diffModule.setInput(i%4, i*397%4096);
+
+      n=lcdEncode(out, sizeof(out), LCD_SETPOS, &arg, 1, NULL, 0);
+      naiveBus.write(out, n);
+      n=lcdEncode(out, sizeof(out), LCD_DISPLAY_LONG_TEXT, NULL, 0, (const uint8_t *)frame, 2*COLS);
+      naiveBus.write(out, n);
+
+      master.show(frame);
+
+      if (naiveModule.panel() != frame || diffModule.panel() != frame
+          || master.shadow() != diffModule.screen() || master.cursor() != diffModule.cursor()) {
+         printf("%s frame %d: panel \"%s\", expected \"%s\"\n",
+                name, i, diffModule.panel().c_str(), frame);
+         failures++;
+         return;
+      }
+   }
+
+   printf("%-10s %6d %10ld %10ld %6.1f%% %9.1f %9.1f\n", name, frames,
+          naiveBus.bytes, diffBus.bytes, 100.0-100.0*diffBus.bytes/naiveBus.bytes,
+          naiveBus.us/1000, diffBus.us/1000);
+}
+
+
+int main(int argc, char **argv) {
+   int i;
+
+   for (i=1;i<argc;i++) {
+      if (strcmp(argv[i], "-k") == 0 && i+1 < argc)
+         khz=atoi(argv[++i]);
+      else if (strcmp(argv[i], "-f") == 0 && i+1 < argc)
+         frames=atoi(argv[++i]);
+      else if (strcmp(argv[i], "-a") == 0)
+         atomic=true;
+      else if (strcmp(argv[i], "-v") == 0)
+         verbose=true;
+      else {
+         fprintf(stderr, "usage: lcdbench [-k kHz] [-f frames] [-a] [-v]\n");
+         return(2);
+      }
+   }
+   if (khz <= 0 || frames <= 0) {
+      fprintf(stderr, "lcdbench: bad -k or -f\n");
+      return(2);
+   }
+
+   printf("%-10s %6s %10s %10s %7s %9s %9s   (%d kHz)\n", "scenario", "frames",
+          "naive B", "diff B", "saved", "naive ms", "diff ms", khz);
+   runScenario("counter", counterFrame);
+   runScenario("dashboard", dashboardFrame);
+   runScenario("pages", pagesFrame);
+   runScenario("random", randomFrame);
+
+   return(failures != 0);
+}
@@ -0,0 +1,93 @@
+// CCS C built-ins for the host build of the firmware
+//
+// The firmware sources are compiled unchanged apart from the few CCS
+// preprocessor directives the Makefile rewrites (see there). Everything
+// the CCS compiler provides as a built-in function is declared here and
+// implemented by hal.c, which charges simulated time for each of them.
+
+#ifndef CCS_H
+#define CCS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef uint8_t  int8;
+typedef uint16_t int16;
+typedef uint32_t int32;
+typedef uint8_t  int1;
+typedef int8_t   sint8;
+typedef int16_t  sint16;
+typedef int32_t  sint32;
+typedef uint8_t  BYTE;
+
+#define TRUE  1
+#define FALSE 0
+
+// special function registers used through #bit / #byte
+typedef union {
+   uint8_t v;
+   struct { unsigned b0:1, b1:1, b2:1, b3:1, b4:1, b5:1, b6:1, b7:1; };
+} hal_reg_t;
+
+extern hal_reg_t hal_reg[512];
+
+#define bit_set(v,b)    ((v) |= ((uint32_t)1 << (b)))
+#define bit_clear(v,b)  ((v) &= ~((uint32_t)1 << (b)))
+#define bit_test(v,b)   (((v) >> (b)) & 1)
+#define make8(v,n)      ((uint8_t)((v) >> (8*(n))))
+#define make16(h,l)     ((uint16_t)(((uint16_t)(h) << 8) | (uint8_t)(l)))
+#define make32(h,l)     ((uint32_t)(((uint32_t)(h) << 16) | (uint16_t)(l)))
+
+// pins
+void output_high(int pin);
+void output_low(int pin);
+void output_bit(int pin, int level);
+void output_toggle(int pin);
+void output_float(int pin);
+void output_drive(int pin);
+int hal_input(int pin);
+#define input(pin) hal_input(pin)     // the firmware also has a variable called input
+
+// ports
+void output_a(int value);
+void output_b(int value);
+void output_c(int value);
+int input_a(void);
+int input_b(void);
+int input_c(void);
+void set_tris_a(int value);
+void set_tris_b(int value);
+void set_tris_c(int value);
+
+// delays
+void delay_cycles(unsigned n);
+void delay_us(unsigned n);
+void delay_ms(unsigned n);
+
+// i2c slave
+int i2c_isr_state(void);
+int i2c_poll(void);
+int i2c_read(void);
+void i2c_write(int value);
+
+// interrupts
+void enable_interrupts(long which);
+void disable_interrupts(long which);
+void clear_interrupt(long which);
+int interrupt_active(long which);
+
+// timers and peripherals
+void setup_counters(int source, int prescale);
+void setup_timer_1(int mode);
+void set_timer0(int value);
+int get_timer0(void);
+void set_timer1(unsigned value);
+unsigned get_timer1(void);
+void setup_adc_ports(int value);
+void setup_adc(int value);
+
+int shift_left(void *address, int bytes, int value);
+int shift_right(void *address, int bytes, int value);
+
+#endif
@@ -0,0 +1,70 @@
+// Checks formatDecimal() against sprintf() for all 65536 inputs
+//
+//    make test
+//
+// Every value is formatted with every digit count (0-5), with space and
+// zero padding, and with no decimal point or one before the last 1-4
+// digits. The expected text is the "%u" of the value, padded with zeros
+// to at least point+1 digits, then padded to the digit count and split
+// by the decimal point. formatDecimal() must write exactly that and
+// nothing behind it. Exits with 1 on the first mismatch.
+
+#include <stdio.h>
+#include <string.h>
+#include "formatDecimal.c"    // the firmware's, as rewritten for gcc in build/
+
+#define GUARD 0x5A
+
+
+static void expected(char *out, unsigned value, int digits, int flags) {
+   char text[16];
+   int point, len, n;
+
+   point=flags & FMT_POINT_MASK;
+   len=sprintf(text, "%0*u", point+1, value);
+
+   n=digits > len ? digits : len;
+   memset(out, (flags & FMT_ZERO_PAD) ? '0' : ' ', n-len);
+   memcpy(out+n-len, text, len);
+   out[n]='\0';
+
+   if (point != 0) {
+      memmove(out+n-point+1, out+n-point, point+1);
+      out[n-point]='.';
+   }
+}
+
+
+int main(void) {
+   char want[16], got[16];
+   unsigned value;
+   int digits, pad, point, flags, n, i;
+   long checked=0;
+
+   for (digits=0;digits<=5;digits++)
+   for (pad=0;pad<2;pad++)
+   for (point=0;point<=4;point++) {
+      flags=(pad ? FMT_ZERO_PAD : 0) | FMT_POINT(point);
+
+      for (value=0;value<=0xFFFF;value++) {
+         expected(want, value, digits, flags);
+         memset(got, GUARD, sizeof(got));
+         n=formatDecimal(value, got, digits, flags);
+
+         for (i=n;i<(int)sizeof(got);i++) {
+            if ((unsigned char)got[i] != GUARD)
+               break;
+         }
+         if (n < 0 || n >= (int)sizeof(got) || i != (int)sizeof(got)
+             || (size_t)n != strlen(want) || memcmp(got, want, n) != 0) {
+            printf("formatDecimal(%u, %d, 0x%02X): \"%.*s\" (%d), expected \"%s\"\n",
+                   value, digits, flags, n > 0 && n < 16 ? n : 0, got, n, want);
+            return(1);
+         }
+         checked++;
+      }
+   }
+
+   printf("formatDecimal: %ld conversions ok\n", checked);
+   return(0);
+}
@@ -0,0 +1,540 @@
+// The PIC16F886 as seen by the firmware: simulated time, pins, timers,
+// interrupts and the MSSP in i2c slave mode.
+//
+// Time is counted in instruction cycles (4 clocks). Every built-in the
+// firmware calls charges an estimate of what CCS generates for it, delays
+// charge exactly what they ask for, and each function call charges
+// SIM_CALL_CYCLES (the firmware is compiled with -finstrument-functions).
+// Plain C statements are free, so the totals are a lower bound that is
+// dominated by what matters here: lcd and SPI bit banging and delays.
+//
+// Interrupts are taken between built-ins, in #priority order, and delay
+// loops are stretched by the time spent in them, like on the chip.
+
+#include <stdlib.h>
+#include "sim.h"
+
+#define SIM_CALL_CYCLES   4     // call + return
+#define SIM_ISR_ENTRY     30    // CCS saves the context and finds the source
+#define SIM_ISR_EXIT      20
+#define SIM_PIN_CYCLES    1     // bsf / bcf on a fast_io port
+#define SIM_TRIS_CYCLES   3     // extra bank switching and TRIS write of standard_io
+
+#define SSPCON   hal_reg[SSPCON_ADDR]
+#define SSPCON2  hal_reg[SSPCON2_ADDR]
+// SSPCON: b7 WCOL, b6 SSPOV, b5 SSPEN, b4 CKP.  SSPCON2: b7 GCEN, b0 SEN
+
+hal_reg_t hal_reg[512];
+uint64_t simCycles=0;
+
+// set by the Makefile's rewrite of #use fast_io() and #use i2c()
+__attribute__((weak)) uint8_t simFastIoA, simFastIoB, simFastIoC;
+__attribute__((weak)) uint8_t simI2cAddress;
+
+// interrupt service routines of the firmware (the #int_xxx lines)
+extern void ssp_interrupt(void) __attribute__((weak));
+extern void rtcc_isr(void) __attribute__((weak));
+extern void timer1_isr(void) __attribute__((weak));
+
+static uint8_t portLatch[3];
+static uint8_t portTris[3]={0xFF, 0xFF, 0xFF};
+
+static uint8_t intEnable, intFlag;
+static int gie, inIsr;
+
+static int t0Running, t1Running;
+static unsigned t0Prescale, t1Prescale;
+static uint64_t t0Origin, t0Next, t1Origin, t1Next;
+
+static uint8_t sspBuf, sspTx;
+static int sspBf, sspTxFull, sspState, sspCount;
+
+static int depth, maxDepth;
+
+static struct {
+   unsigned long count;
+   uint64_t total;
+   unsigned long max;
+} isrStats[3];
+static const char *isrNames[3]={"ssp", "rtcc", "timer1"};
+
+static unsigned long sspBytes, sspNacks, sspOverflows;
+
+
+static uint8_t *fastIo(int port) {
+   static uint8_t *ports[3]={&simFastIoA, &simFastIoB, &simFastIoC};
+   return(ports[port]);
+}
+
+
+static void pinsChanged(void) {
+   simLcdPins();
+   simMcpPins();
+}
+
+
+static void dispatch(void);
+
+static void runEvents(void) {
+   while (t0Running && simCycles >= t0Next) {
+      intFlag|=INT_RTCC;
+      t0Next+=256UL*t0Prescale;
+   }
+   while (t1Running && simCycles >= t1Next) {
+      intFlag|=INT_TIMER1;
+      t1Next+=65536UL*t1Prescale;
+   }
+   if (simCycles >= simMasterNext) {
+      simMasterRun();
+      if (simMasterNext <= simCycles)
+         simMasterNext=simCycles+1;   // keeps time moving
+   }
+}
+
+
+// Let 'cycles' instruction cycles pass. Interrupts that fall due are
+// taken on the way and lengthen the wait.
+void simCharge(unsigned long cycles) {
+   uint64_t target, next, before;
+
+   target=simCycles+cycles;
+   do {
+      next=target;
+      if (t0Running && t0Next < next)     next=t0Next;
+      if (t1Running && t1Next < next)     next=t1Next;
+      if (simMasterNext < next)           next=simMasterNext;
+      if (next > simCycles)
+         simCycles=next;
+
+      runEvents();
+
+      if (!inIsr && gie && (intFlag & intEnable)) {
+         before=simCycles;
+         dispatch();
+         target+=simCycles-before;
+      }
+   } while (simCycles < target);
+}
+
+
+static void dispatch(void) {
+   uint8_t pending, which;
+   int i;
+   void (*isr)(void);
+   uint64_t start;
+   unsigned long used;
+
+   while (gie && (pending=intFlag & intEnable) != 0) {
+      for (i=0; !(pending & (1 << i)); i++)
+         ;
+      which=1 << i;
+      intFlag&=~which;
+
+      isr= which==INT_SSP ? ssp_interrupt : which==INT_RTCC ? rtcc_isr : timer1_isr;
+      if (isr == NULL)
+         continue;
+
+      start=simCycles;
+      inIsr=1;
+      simCharge(SIM_ISR_ENTRY);
+      isr();
+      simCharge(SIM_ISR_EXIT);
+      inIsr=0;
+
+      used=simCycles-start;
+      isrStats[i].count++;
+      isrStats[i].total+=used;
+      if (used > isrStats[i].max)
+         isrStats[i].max=used;
+   }
+}
+
+
+// called by gcc on every function entry and exit of the firmware
+void __cyg_profile_func_enter(void *fn, void *site) {
+   (void)fn; (void)site;
+   if (++depth > maxDepth)
+      maxDepth=depth;
+   simCharge(SIM_CALL_CYCLES);
+}
+
+void __cyg_profile_func_exit(void *fn, void *site) {
+   (void)fn; (void)site;
+   depth--;
+}
+
+
+void simInit(void) {
+   SSPCON.b5=1;   // SSPEN, done by the CCS start up code for #use i2c
+   SSPCON.b4=1;   // CKP
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//  pins and ports
+
+int simPinLevel(int pin) {
+   int port=PIN_PORT(pin), bit=PIN_BIT(pin);
+
+   if (bit_test(portTris[port], bit))
+      return(-1);
+   return(bit_test(portLatch[port], bit));
+}
+
+uint8_t simPortOut(int port) {
+   return(portLatch[port]);
+}
+
+
+static void setPin(int pin, int level) {
+   int port=PIN_PORT(pin), bit=PIN_BIT(pin);
+
+   if (level)
+      bit_set(portLatch[port], bit);
+   else
+      bit_clear(portLatch[port], bit);
+
+   if (!*fastIo(port)) {
+      bit_clear(portTris[port], bit);
+      simCharge(SIM_TRIS_CYCLES);
+   }
+   pinsChanged();
+}
+
+void output_high(int pin)   { setPin(pin, 1); simCharge(SIM_PIN_CYCLES); }
+void output_low(int pin)    { setPin(pin, 0); simCharge(SIM_PIN_CYCLES); }
+void output_bit(int pin, int level) { setPin(pin, level != 0); simCharge(4); }
+
+void output_toggle(int pin) {
+   setPin(pin, !bit_test(portLatch[PIN_PORT(pin)], PIN_BIT(pin)));
+   simCharge(SIM_PIN_CYCLES);
+}
+
+void output_float(int pin) {
+   bit_set(portTris[PIN_PORT(pin)], PIN_BIT(pin));
+   pinsChanged();
+   simCharge(SIM_TRIS_CYCLES);
+}
+
+void output_drive(int pin) {
+   bit_clear(portTris[PIN_PORT(pin)], PIN_BIT(pin));
+   pinsChanged();
+   simCharge(SIM_TRIS_CYCLES);
+}
+
+
+// what the pins of a port read: outputs read their latch, inputs read
+// whatever drives them (pulled up when nothing does)
+static uint8_t readPort(int port) {
+   uint8_t value, bus;
+
+   value=portLatch[port] & ~portTris[port];
+   value|=portTris[port];
+
+   if (port == PIN_PORT(PIN_B0) && simLcdDrivesBus(&bus))
+      value=(value & ~portTris[port]) | (bus & portTris[port]);
+   if (port == PIN_PORT(BOARD_MCP_DOUT) && bit_test(portTris[port], PIN_BIT(BOARD_MCP_DOUT))) {
+      if (!simMcpDout())
+         bit_clear(value, PIN_BIT(BOARD_MCP_DOUT));
+   }
+   return(value);
+}
+
+int hal_input(int pin) {
+   int port=PIN_PORT(pin);
+
+   if (!*fastIo(port) && !bit_test(portTris[port], PIN_BIT(pin))) {
+      bit_set(portTris[port], PIN_BIT(pin));
+      pinsChanged();
+      simCharge(SIM_TRIS_CYCLES);
+   }
+   simCharge(2);
+   return(bit_test(readPort(port), PIN_BIT(pin)));
+}
+
+
+static void outputPort(int port, int value) {
+   portLatch[port]=value;
+   if (!*fastIo(port)) {
+      portTris[port]=0;
+      simCharge(SIM_TRIS_CYCLES);
+   }
+   pinsChanged();
+   simCharge(2);
+}
+
+static int inputPort(int port) {
+   if (!*fastIo(port)) {
+      portTris[port]=0xFF;
+      pinsChanged();
+      simCharge(SIM_TRIS_CYCLES);
+   }
+   simCharge(2);
+   return(readPort(port));
+}
+
+static void setTris(int port, int value) {
+   portTris[port]=value;
+   pinsChanged();
+   simCharge(3);
+}
+
+void output_a(int value) { outputPort(0, value); }
+void output_b(int value) { outputPort(1, value); }
+void output_c(int value) { outputPort(2, value); }
+int input_a(void)        { return(inputPort(0)); }
+int input_b(void)        { return(inputPort(1)); }
+int input_c(void)        { return(inputPort(2)); }
+void set_tris_a(int value) { setTris(0, value); }
+void set_tris_b(int value) { setTris(1, value); }
+void set_tris_c(int value) { setTris(2, value); }
+
+
+////////////////////////////////////////////////////////////////////////////
+//  delays
+
+void delay_cycles(unsigned n) { simCharge(n); }
+void delay_us(unsigned n)     { simCharge((unsigned long)n*SIM_CYCLES_PER_US); }
+void delay_ms(unsigned n)     { simCharge((unsigned long)n*1000*SIM_CYCLES_PER_US); }
+
+
+////////////////////////////////////////////////////////////////////////////
+//  interrupts
+
+void enable_interrupts(long which) {
+   if (which == GLOBAL)
+      gie=1;
+   else
+      intEnable|=which;
+   simCharge(1);
+}
+
+void disable_interrupts(long which) {
+   if (which == GLOBAL)
+      gie=0;
+   else
+      intEnable&=~which;
+   simCharge(1);
+}
+
+int simIntEnabled(long which) {
+   return((intEnable & which) != 0);
+}
+
+void clear_interrupt(long which) {
+   intFlag&=~which;
+   simCharge(1);
+}
+
+int interrupt_active(long which) {
+   simCharge(1);
+   return((intFlag & which) != 0);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//  timers
+
+void setup_counters(int source, int prescale) {
+   int value;
+
+   (void)source;
+   value=t0Running ? get_timer0() : 0;
+   t0Prescale=(prescale & RTCC_DIV_1) ? 1 : 2U << (prescale & 7);
+   t0Running=1;
+   set_timer0(value);
+}
+
+void set_timer0(int value) {
+   t0Origin=simCycles-(uint64_t)(value & 0xFF)*t0Prescale;
+   t0Next=t0Origin+256UL*t0Prescale;
+   simCharge(2);
+}
+
+int get_timer0(void) {
+   simCharge(1);
+   if (!t0Running)
+      return(0);
+   return(((simCycles-t0Origin)/t0Prescale) & 0xFF);
+}
+
+void setup_timer_1(int mode) {
+   t1Running=(mode & T1_INTERNAL) == T1_INTERNAL;
+   t1Prescale=1U << ((mode >> 4) & 3);
+   set_timer1(0);
+}
+
+void set_timer1(unsigned value) {
+   t1Origin=simCycles-(uint64_t)(value & 0xFFFF)*t1Prescale;
+   t1Next=t1Origin+65536UL*t1Prescale;
+   simCharge(4);
+}
+
+unsigned get_timer1(void) {
+   simCharge(4);
+   if (!t1Running)
+      return(0);
+   return(((simCycles-t1Origin)/t1Prescale) & 0xFFFF);
+}
+
+void setup_adc_ports(int value) { (void)value; simCharge(2); }
+void setup_adc(int value)       { (void)value; simCharge(2); }
+
+
+int shift_left(void *address, int bytes, int value) {
+   uint8_t *p=address;
+   int i, out=0;
+
+   for (i=0;i<bytes;i++) {
+      out=p[i] >> 7;
+      p[i]=(p[i] << 1) | (value & 1);
+      value=out;
+   }
+   simCharge(bytes+2);
+   return(out);
+}
+
+int shift_right(void *address, int bytes, int value) {
+   uint8_t *p=address;
+   int i, out=0;
+
+   for (i=bytes-1;i>=0;i--) {
+      out=p[i] & 1;
+      p[i]=(p[i] >> 1) | ((value & 1) << 7);
+      value=out;
+   }
+   simCharge(bytes+2);
+   return(out);
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+//  MSSP, i2c slave
+//
+//  i2c_isr_state() follows the CCS numbering: 0 = address (write),
+//  1-0x7F = bytes written by the master, 0x80 = address (read),
+//  0x81-0xFF = byte read and acknowledged. After the master NACKs the
+//  last byte of a read the slave logic resets and the interrupt reports
+//  a write state with nothing in the buffer (i2c_poll() is false).
+
+static int sspReceive(uint8_t value) {
+   if (!SSPCON.b5)
+      return(SSP_NACK);
+
+   if (sspBf || SSPCON.b6) {
+      SSPCON.b6=1;   // SSPOV, the byte is not acknowledged
+      sspOverflows++;
+      sspNacks++;
+      intFlag|=INT_SSP;   // SSPIF is set all the same
+      return(SSP_NACK);
+   }
+
+   sspBuf=value;
+   sspBf=1;
+   if (SSPCON2.b0)
+      SSPCON.b4=0;   // SEN: hold the clock until the firmware sets CKP
+   intFlag|=INT_SSP;
+   sspBytes++;
+   return(SSP_ACK);
+}
+
+int simSspAddress(uint8_t address) {
+   int match;
+
+   match=(address & 0xFE) == (simI2cAddress & 0xFE) || (address == 0 && SSPCON2.b7);
+   if (!match)
+      return(SSP_NACK);
+
+   if (sspReceive(address) == SSP_NACK)
+      return(SSP_NACK);
+
+   if (address & 1) {
+      sspState=0x80;
+      sspCount=0x81;
+      sspTxFull=0;
+      SSPCON.b4=0;   // hold the clock until the first byte is loaded
+   } else {
+      sspState=0;
+      sspCount=1;
+   }
+   return(SSP_ACK);
+}
+
+int simSspWrite(uint8_t value) {
+   if (sspReceive(value) == SSP_NACK)
+      return(SSP_NACK);
+   sspState=sspCount;
+   if (sspCount < 0x7F)
+      sspCount++;
+   return(SSP_ACK);
+}
+
+int simSspClockHeld(void) {
+   return(!SSPCON.b4);
+}
+
+uint8_t simSspRead(int ack) {
+   uint8_t value;
+
+   value=sspTxFull ? sspTx : 0xFF;
+   sspTxFull=0;
+   sspBytes++;
+
+   if (ack) {
+      sspState=sspCount;
+      if (sspCount < 0xFF)
+         sspCount++;
+      SSPCON.b4=0;
+   } else {
+      sspState=sspCount & 0x7F;
+   }
+   intFlag|=INT_SSP;
+   return(value);
+}
+
+int i2c_isr_state(void) {
+   simCharge(8);
+   return(sspState);
+}
+
+int i2c_poll(void) {
+   simCharge(2);
+   return(sspBf);
+}
+
+int i2c_read(void) {
+   simCharge(3);
+   sspBf=0;
+   return(sspBuf);
+}
+
+void i2c_write(int value) {
+   simCharge(6);
+   sspTx=value;
+   sspTxFull=1;
+   sspBf=0;
+   SSPCON.b4=1;   // CKP, release the clock
+}
+
+
+////////////////////////////////////////////////////////////////////////////
+
+void simPrintStats(FILE *f) {
+   int i;
+
+   fprintf(f, "time      %.3f ms (%llu cycles)\n",
+           simCycles/(1000.0*SIM_CYCLES_PER_US), (unsigned long long)simCycles);
+   for (i=0;i<3;i++) {
+      if (isrStats[i].count == 0) continue;
+      fprintf(f, "isr %-6s %lu calls, avg %.1f us, max %.1f us\n", isrNames[i],
+              isrStats[i].count,
+              (double)isrStats[i].total/isrStats[i].count/SIM_CYCLES_PER_US,
+              (double)isrStats[i].max/SIM_CYCLES_PER_US);
+   }
+   // main() itself does not use a stack level
+   fprintf(f, "stack     %d levels (before CCS inlines single calls)\n", maxDepth-1);
+   fprintf(f, "i2c       %lu bytes, %lu nack, %lu overflows\n", sspBytes, sspNacks, sspOverflows);
+   simLcdStats(f);
+   simMcpStats(f);
+}
+
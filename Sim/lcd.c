@@ -0,0 +1,243 @@
+// HD44780 model: 8 bit bus on port B, RS / RW / EN on port C
+//
+// Instructions and data are latched on the falling edge of EN with RW
+// low. With RW high the controller drives the bus while EN is high: the
+// busy flag and address counter (RS low) or the DDRAM / CGRAM data at the
+// address counter (RS high).
+//
+// Each instruction keeps the controller busy for its datasheet execution
+// time (37 usec, 1.52 msec for clear and home). Anything written while it
+// is busy is counted as a violation and ignored, like a real controller
+// may do. EN pulses shorter than 230 nsec are counted as well.
+//
+// The two lines hold 40 characters each (0x00-0x27 and 0x40-0x67). The
+// display shows 16 of them from the current display shift.
+
+#include "sim.h"
+
+#define LCD_EXEC_US       37
+#define LCD_EXEC_LONG_US  1520
+#define LCD_PWEH_NS       230     // minimum EN high time
+#define LCD_LINE_LEN      40
+
+static uint8_t ddram[0x80];
+static uint8_t cgram[64];
+static uint8_t ac;                // address counter
+static int cgMode;                // the address counter points into CGRAM
+static int increment=1, shiftOnWrite;
+static int displayOn, cursorOn, blinkOn;
+static int twoLines=1;
+static int shift;                 // display shift, 0-39
+static uint64_t busyUntil;
+
+static int lastEn, lastRs, lastRw;
+static uint64_t enRise;
+
+static unsigned long instructions, dataWrites, busyViolations, pulseViolations;
+
+
+static void powerOn(void) {
+   static int done;
+
+   if (done) return;
+   memset(ddram, ' ', sizeof(ddram));
+   done=1;
+}
+
+
+static int busy(void) {
+   return(simCycles < busyUntil);
+}
+
+
+static void moveAc(int up) {
+   if (cgMode) {
+      ac=(ac + (up ? 1 : -1)) & 0x3F;
+      return;
+   }
+   if (up) {
+      ac++;
+      if (ac == LCD_LINE_LEN)          ac=0x40;
+      else if (ac == 0x40+LCD_LINE_LEN) ac=0x00;
+   } else {
+      if (ac == 0x00)      ac=0x40+LCD_LINE_LEN-1;
+      else if (ac == 0x40) ac=LCD_LINE_LEN-1;
+      else ac--;
+   }
+}
+
+
+static void shiftDisplay(int right) {
+   shift=(shift + (right ? LCD_LINE_LEN-1 : 1)) % LCD_LINE_LEN;
+}
+
+
+static void instruction(uint8_t code) {
+   unsigned exec=LCD_EXEC_US;
+
+   instructions++;
+
+   if (code & 0x80) {              // set DDRAM address
+      ac=code & 0x7F;
+      cgMode=0;
+   } else if (code & 0x40) {       // set CGRAM address
+      ac=code & 0x3F;
+      cgMode=1;
+   } else if (code & 0x20) {       // function set
+      twoLines=(code >> 3) & 1;
+   } else if (code & 0x10) {       // cursor or display shift
+      if (code & 0x08)
+         shiftDisplay(code & 0x04);
+      else
+         moveAc(code & 0x04);
+   } else if (code & 0x08) {       // display on/off control
+      displayOn=(code >> 2) & 1;
+      cursorOn=(code >> 1) & 1;
+      blinkOn=code & 1;
+   } else if (code & 0x04) {       // entry mode set
+      increment=(code >> 1) & 1;
+      shiftOnWrite=code & 1;
+   } else if (code & 0x02) {       // return home
+      ac=0;
+      cgMode=0;
+      shift=0;
+      exec=LCD_EXEC_LONG_US;
+   } else if (code & 0x01) {       // clear display
+      memset(ddram, ' ', sizeof(ddram));
+      ac=0;
+      cgMode=0;
+      shift=0;
+      increment=1;
+      exec=LCD_EXEC_LONG_US;
+   }
+
+   busyUntil=simCycles+(uint64_t)exec*SIM_CYCLES_PER_US;
+}
+
+
+static void writeData(uint8_t value) {
+   dataWrites++;
+
+   if (cgMode)
+      cgram[ac & 0x3F]=value & 0x1F;
+   else
+      ddram[ac & 0x7F]=value;
+   moveAc(increment);
+   if (shiftOnWrite && !cgMode)
+      shiftDisplay(!increment);
+
+   busyUntil=simCycles+(uint64_t)LCD_EXEC_US*SIM_CYCLES_PER_US;
+}
+
+
+// called by hal.c whenever a pin may have changed
+void simLcdPins(void) {
+   int en, rs, rw;
+
+   powerOn();
+
+   en=simPinLevel(BOARD_LCD_EN) == 1;
+   rs=simPinLevel(BOARD_LCD_RS) == 1;
+   rw=simPinLevel(BOARD_LCD_RW) == 1;
+
+   if (en && !lastEn)
+      enRise=simCycles;
+
+   if (!en && lastEn) {
+      if ((simCycles-enRise)*SIM_NS_PER_CYCLE < LCD_PWEH_NS)
+         pulseViolations++;
+
+      if (!lastRw) {
+         if (busy() && instructions+dataWrites >= 3) {
+            // (the first function sets are sent before the busy flag works)
+            busyViolations++;
+         } else if (lastRs) {
+            writeData(simPortOut(PIN_PORT(PIN_B0)));
+         } else {
+            instruction(simPortOut(PIN_PORT(PIN_B0)));
+         }
+      } else if (lastRs) {
+         moveAc(increment);       // data read moves the address counter too
+      }
+   }
+
+   lastEn=en;
+   lastRs=rs;
+   lastRw=rw;
+}
+
+
+// the value the controller puts on the bus, if it drives it
+int simLcdDrivesBus(uint8_t *value) {
+   if (!lastEn || !lastRw)
+      return(0);
+
+   if (!lastRs)
+      *value=(busy() ? 0x80 : 0) | (ac & 0x7F);
+   else if (cgMode)
+      *value=cgram[ac & 0x3F];
+   else
+      *value=ddram[ac & 0x7F];
+   return(1);
+}
+
+
+// the 16 characters shown on a line. Custom characters (0-15) show as '#',
+// the full block (0xFF) as '='
+void simLcdRow(int row, char text[17]) {
+   int i;
+   uint8_t c;
+
+   powerOn();
+   for (i=0;i<16;i++) {
+      c=ddram[row*0x40 + (i+shift) % LCD_LINE_LEN];
+      if (!displayOn || (row == 1 && !twoLines))
+         c=' ';
+      else if (c < 0x10)
+         c='#';
+      else if (c == 0xFF)
+         c='=';
+      else if (c < 0x20 || c > 0x7E)
+         c='?';
+      text[i]=c;
+   }
+   text[16]='\0';
+}
+
+
+void simLcdPrint(FILE *f) {
+   char text[17];
+   int row, col;
+
+   fprintf(f, "+----------------+\n");
+   for (row=0;row<2;row++) {
+      simLcdRow(row, text);
+      fprintf(f, "|%s|", text);
+      if (displayOn && cursorOn && !cgMode && (ac >> 6) == row) {
+         col=((ac & 0x3F) + LCD_LINE_LEN - shift) % LCD_LINE_LEN;
+         if (col < 16)
+            fprintf(f, " cursor %d", col);
+      }
+      fprintf(f, "\n");
+   }
+   fprintf(f, "+----------------+\n");
+}
+
+
+void simLcdPrintCgram(FILE *f) {
+   int ch, row, bit;
+
+   for (row=0;row<8;row++) {
+      for (ch=0;ch<8;ch++) {
+         for (bit=4;bit>=0;bit--)
+            fputc(bit_test(cgram[ch*8+row], bit) ? '#' : '.', f);
+         fputc(ch < 7 ? ' ' : '\n', f);
+      }
+   }
+}
+
+
+void simLcdStats(FILE *f) {
+   fprintf(f, "lcd       %lu instructions, %lu characters, %lu written while busy, %lu short EN pulses\n",
+           instructions, dataWrites, busyViolations, pulseViolations);
+}
@@ -0,0 +1,526 @@
+// Scriptable i2c master standing in for the gogo board
+//
+//    pcbsim [-v] script
+//
+// The script is read one command per line ('#' starts a comment). Each
+// command runs in simulated time while the firmware keeps running:
+//
+//    speed <kHz>            bus clock, 100 by default
+//    write [@addr] <bytes>  one write transaction. Bytes are numbers
+//                           (12, 0x0C) or "quoted text"; @addr sends to
+//                           another 8 bit address (e.g. @0 general call)
+//    read [@addr] <n>       one read transaction of n bytes, printed in hex
+//    wait <ms>              let the firmware run (fractions allowed)
+//    waitint <ms>           wait until the interrupt line is pulled low, at
+//                           most <ms>
+//    adc <ch> <counts>      set an MCP3208 input (0-4095)
+//    screen                 print the lcd
+//    cgram                  print the 8 custom characters
+//    stats                  print the timing statistics
+//    expect <row> "text"    fail unless lcd row 0/1 shows text
+//    expectread <bytes>     fail unless the last read returned these bytes,
+//                           ? matches any byte
+//
+// The run ends after the last command. The exit status is 1 when an
+// expectation failed or the MCP3208 model saw a bad frame or timing (see
+// mcp3208.c), so scripts can be used as regression tests. -v
+// prints each transaction with its time.
+//
+// simServe() takes the transactions from a pipe instead, for the loopback
+// bench in ../Host (see lcdLoopback.cpp), with the bus at khz. A request
+// is an op byte and a count byte:
+//
+//    'W' n <n bytes>   write transaction, answered by ok (1/0) and 0
+//    'R' n             read transaction, answered by ok, n and the bytes
+//    'A' ch <2 bytes>  set MCP3208 input ch to the 12 bit value (high byte
+//                      first), answered by 1 and 0
+//    'S' 0             run until the firmware has caught up, at most
+//                      SETTLE_MAX_MS, and answer with settled (1/0), the
+//                      32 bytes of curText, the 32 characters on the lcd
+//                      and the input cursor
+//
+// The first request is taken BOOT_MS after power up. The child process
+// ends when the bench closes the pipe.
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include "sim.h"
+
+#define MAX_BYTES   64
+#define HOLD_MAX_US 25000     // give up on a slave that holds the clock
+#define SETTLE_MAX_MS 200     // simServe(): give up waiting for the screen
+#define BOOT_MS     200       // simServe(): init() is done by then
+#define SIM_CELLS   32        // 16x2, as the lcd model
+
+extern void firmware_main(void);
+
+// firmware globals (build/PCB.c) the bench waits for and looks at
+extern int8 gblCmdHead, gblCmdTail;
+extern int1 gblFrameOpen;
+extern int8 inputCursor;
+extern char curText[];
+
+uint64_t simMasterNext=0;
+
+static FILE *script;
+static const char *scriptName;
+static int lineNo, verbose, failures;
+
+static unsigned long bitCycles=SIM_CLOCK/4/100000;
+
+// transaction in progress
+enum { IDLE, SEND, RECEIVE, HOLD, STOP, WAIT_INT, SETTLE };
+static int phase=IDLE;
+static uint8_t bytes[MAX_BYTES];
+static int count, sent, reading;
+static uint8_t readBytes[MAX_BYTES];
+static int readCount;
+static uint64_t holdStart, waitEnd;
+
+// simServe(): the pipes to the bench, -1 when running a script
+static int serveIn=-1, serveOut=-1;
+
+
+static void finish(void) {
+   if (simMcpErrors() != 0) {
+      printf("%s: %lu MCP3208 frame or timing errors\n", scriptName, simMcpErrors());
+      failures++;
+   }
+   if (verbose)
+      simPrintStats(stdout);
+   exit(failures ? 1 : 0);
+}
+
+
+static void error(const char *what) {
+   fprintf(stderr, "%s:%d: %s\n", scriptName, lineNo, what);
+   exit(2);
+}
+
+
+static double msNow(void) {
+   return(simCycles/(1000.0*SIM_CYCLES_PER_US));
+}
+
+
+// parses "12 0x0C "text"" into bytes[], returns the count. With any[],
+// "?" stands for any byte and sets its flag.
+static int parseBytes(char *p, uint8_t *out, uint8_t *any) {
+   int n=0;
+   char *end;
+
+   for (;;) {
+      while (isspace((unsigned char)*p)) p++;
+      if (*p == '\0' || *p == '#')
+         return(n);
+      if (n >= MAX_BYTES)
+         error("too many bytes");
+
+      if (*p == '"') {
+         for (p++; *p && *p != '"'; p++) {
+            if (n >= MAX_BYTES)
+               error("too many bytes");
+            out[n++]=*p;
+         }
+         if (*p != '"')
+            error("missing \"");
+         p++;
+      } else if (*p == '?' && any) {
+         any[n]=1;
+         out[n++]=0;
+         p++;
+      } else {
+         out[n++]=strtoul(p, &end, 0);
+         if (end == p)
+            error("bad byte");
+         p=end;
+      }
+   }
+}
+
+
+static char *parseAddress(char *p, uint8_t *address) {
+   char *end;
+
+   while (isspace((unsigned char)*p)) p++;
+   if (*p != '@')
+      return(p);
+   *address=strtoul(p+1, &end, 0);
+   return(end);
+}
+
+
+static void startTransaction(uint8_t address, int isRead) {
+   reading=isRead;
+   sent=0;
+   readCount=0;
+   bytes[0]=(address & 0xFE) | isRead;
+   phase=SEND;
+   simMasterNext=simCycles+10*bitCycles;   // start condition + address byte
+}
+
+
+// the expected text may be shorter than the row, the rest must be blank
+static void expectRow(int row, char *p) {
+   char text[17], want[17];
+   int n=0;
+
+   while (isspace((unsigned char)*p)) p++;
+   if (*p++ != '"')
+      error("expect: missing text");
+   memset(want, ' ', 16);
+   want[16]='\0';
+   while (*p && *p != '"' && n < 16)
+      want[n++]=*p++;
+
+   simLcdRow(row, text);
+   if (strcmp(text, want) != 0) {
+      printf("%s:%d: row %d is \"%s\", expected \"%s\"\n", scriptName, lineNo, row, text, want);
+      failures++;
+   }
+}
+
+
+static void expectRead(char *p) {
+   uint8_t want[MAX_BYTES], any[MAX_BYTES];
+   int n, i, same;
+
+   memset(any, 0, sizeof(any));
+   n=parseBytes(p, want, any);
+   same=(n == readCount);
+   for (i=0;i<n && same;i++)
+      same=any[i] || want[i] == readBytes[i];
+   if (!same) {
+      printf("%s:%d: read", scriptName, lineNo);
+      for (i=0;i<readCount;i++)
+         printf(" %02x", readBytes[i]);
+      printf(", expected");
+      for (i=0;i<n;i++)
+         printf(" %02x", want[i]);
+      printf("\n");
+      failures++;
+   }
+}
+
+
+static void serveRead(uint8_t *data, int len) {
+   int n;
+
+   while (len > 0) {
+      n=read(serveIn, data, len);
+      if (n <= 0)
+         exit(0);   // the bench is done
+      data+=n;
+      len-=n;
+   }
+}
+
+
+static void serveWrite(const uint8_t *data, int len) {
+   if (write(serveOut, data, len) != len)
+      exit(0);
+}
+
+
+// the firmware has carried out all it was sent: the queue is empty and
+// updateScreen() has stopped Timer1, or a frame is open and nothing will
+// be drawn before its commit
+static int settled(void) {
+   return(gblCmdHead == gblCmdTail && (gblFrameOpen || !simIntEnabled(INT_TIMER1)));
+}
+
+
+static void serveScreen(void) {
+   uint8_t reply[2+2*SIM_CELLS];
+   char text[17];
+   int row;
+
+   reply[0]=settled();
+   memcpy(reply+1, curText, SIM_CELLS);
+   for (row=0;row<2;row++) {
+      simLcdRow(row, text);
+      memcpy(reply+1+SIM_CELLS+16*row, text, 16);
+   }
+   reply[1+2*SIM_CELLS]=inputCursor;
+   serveWrite(reply, sizeof(reply));
+}
+
+
+// takes the bench's next request
+static void serveCommand(void) {
+   uint8_t request[2], input[2], reply[2];
+
+   serveRead(request, 2);
+   switch (request[0]) {
+      case 'W':
+      case 'R':
+         count=request[1];
+         if (count > MAX_BYTES-1)
+            exit(2);
+         if (request[0] == 'W') {
+            serveRead(bytes+1, count);
+            count++;   // the address byte
+         }
+         startTransaction(simI2cAddress, request[0] == 'R');
+         break;
+
+      case 'A':
+         if (request[1] > 7)
+            exit(2);
+         serveRead(input, 2);
+         simMcpSetInput(request[1], (input[0] << 8 | input[1]) & 0xFFF);
+         reply[0]=1;
+         reply[1]=0;
+         serveWrite(reply, 2);
+         simMasterNext=simCycles+1;
+         break;
+
+      case 'S':
+         phase=SETTLE;
+         waitEnd=simCycles+(uint64_t)SETTLE_MAX_MS*1000*SIM_CYCLES_PER_US;
+         simMasterNext=simCycles+200*SIM_CYCLES_PER_US;   // the isr first
+         break;
+
+      default:
+         exit(2);
+   }
+}
+
+
+// runs script commands until one of them takes time
+static void nextCommand(void) {
+   char line[256], cmd[32];
+   char *p;
+   int n, ch, value, row;
+   uint8_t addr;
+   double ms;
+
+   if (serveIn >= 0) {
+      serveCommand();
+      return;
+   }
+
+   while (fgets(line, sizeof(line), script)) {
+      lineNo++;
+      if (sscanf(line, "%31s%n", cmd, &n) != 1 || cmd[0] == '#')
+         continue;
+      p=line+n;
+
+      if (strcmp(cmd, "speed") == 0) {
+         if (sscanf(p, "%d", &value) != 1 || value <= 0)
+            error("speed <kHz>");
+         bitCycles=SIM_CLOCK/4/(value*1000UL);
+
+      } else if (strcmp(cmd, "write") == 0 || strcmp(cmd, "read") == 0) {
+         addr=simI2cAddress;
+         p=parseAddress(p, &addr);
+         if (cmd[0] == 'w') {
+            count=1+parseBytes(p, bytes+1, NULL);
+            startTransaction(addr, 0);
+         } else {
+            if (sscanf(p, "%d", &value) != 1 || value <= 0 || value > MAX_BYTES)
+               error("read <n>");
+            count=value;
+            startTransaction(addr, 1);
+         }
+         return;
+
+      } else if (strcmp(cmd, "wait") == 0 || strcmp(cmd, "waitint") == 0) {
+         if (sscanf(p, "%lf", &ms) != 1 || ms < 0)
+            error("wait <ms>");
+         waitEnd=simCycles+(uint64_t)(ms*1000*SIM_CYCLES_PER_US);
+         if (cmd[4] == 'i') {
+            phase=WAIT_INT;
+            simMasterNext=simCycles+SIM_CYCLES_PER_US;
+         } else {
+            simMasterNext=waitEnd;
+         }
+         return;
+
+      } else if (strcmp(cmd, "adc") == 0) {
+         if (sscanf(p, "%d %d", &ch, &value) != 2 || ch < 0 || ch > 7)
+            error("adc <ch> <counts>");
+         simMcpSetInput(ch, value);
+
+      } else if (strcmp(cmd, "screen") == 0) {
+         simLcdPrint(stdout);
+
+      } else if (strcmp(cmd, "cgram") == 0) {
+         simLcdPrintCgram(stdout);
+
+      } else if (strcmp(cmd, "stats") == 0) {
+         simPrintStats(stdout);
+
+      } else if (strcmp(cmd, "expect") == 0) {
+         if (sscanf(p, "%d%n", &row, &n) != 1 || row < 0 || row > 1)
+            error("expect <row> \"text\"");
+         expectRow(row, p+n);
+
+      } else if (strcmp(cmd, "expectread") == 0) {
+         expectRead(p);
+
+      } else {
+         error("unknown command");
+      }
+   }
+   finish();
+}
+
+
+static void endTransaction(const char *result) {
+   uint8_t reply[2+MAX_BYTES];
+   int i;
+
+   if (serveOut >= 0) {
+      reply[0]=(result == NULL);
+      reply[1]=reading ? readCount : 0;
+      memcpy(reply+2, readBytes, reply[1]);
+      serveWrite(reply, 2+reply[1]);
+   } else if (reading) {
+      printf("read:");
+      for (i=0;i<readCount;i++)
+         printf(" %02x", readBytes[i]);
+      if (result)
+         printf(" (%s)", result);
+      printf("\n");
+   } else if (result) {
+      printf("write: %s at byte %d\n", result, sent);
+   }
+   if (verbose)
+      printf("  [%.3f ms]\n", msNow());
+
+   phase=STOP;
+   simMasterNext=simCycles+2*bitCycles;   // stop condition and bus free time
+}
+
+
+// called by hal.c when the time in simMasterNext has come
+void simMasterRun(void) {
+   int ack;
+
+   switch (phase) {
+      case IDLE:
+         nextCommand();
+         break;
+
+      case STOP:
+         phase=IDLE;
+         nextCommand();
+         break;
+
+      case WAIT_INT:
+         if (simPinLevel(BOARD_INT_OUT) == 0) {
+            if (verbose)
+               printf("int [%.3f ms]\n", msNow());
+            phase=IDLE;
+            nextCommand();
+         } else if (simCycles >= waitEnd) {
+            printf("waitint: timeout\n");
+            phase=IDLE;
+            nextCommand();
+         } else {
+            simMasterNext=simCycles+SIM_CYCLES_PER_US;
+         }
+         break;
+
+      case SETTLE:   // simServe(): until the firmware has caught up
+         if (!settled() && simCycles < waitEnd) {
+            simMasterNext=simCycles+100*SIM_CYCLES_PER_US;
+            break;
+         }
+         serveScreen();
+         phase=IDLE;
+         nextCommand();
+         break;
+
+      case SEND:   // a byte has just been clocked out
+         if (sent == 0)
+            ack=simSspAddress(bytes[0]);
+         else
+            ack=simSspWrite(bytes[sent]);
+         if (ack == SSP_NACK) {
+            endTransaction("NACK");
+            break;
+         }
+         sent++;
+         holdStart=simCycles;
+         phase=HOLD;   // the stop condition too waits for the clock
+         simMasterNext=simCycles+1;
+         break;
+
+      case HOLD:   // wait for the slave to release the clock
+         if (simSspClockHeld()) {
+            if (simCycles-holdStart > (uint64_t)HOLD_MAX_US*SIM_CYCLES_PER_US) {
+               endTransaction("clock held");
+               break;
+            }
+            simMasterNext=simCycles+1;
+            break;
+         }
+         if (!reading && sent == count) {
+            endTransaction(NULL);
+            break;
+         }
+         phase=reading ? RECEIVE : SEND;
+         simMasterNext=simCycles+9*bitCycles;
+         break;
+
+      case RECEIVE:   // a byte has just been clocked in
+         ack=readCount+1 < count;
+         readBytes[readCount++]=simSspRead(ack);
+         if (!ack) {
+            endTransaction(NULL);
+            break;
+         }
+         holdStart=simCycles;
+         phase=HOLD;
+         simMasterNext=simCycles+1;
+         break;
+   }
+}
+
+
+static int openScript(int argc, char *argv[]) {
+   int i;
+
+   for (i=1;i<argc && argv[i][0] == '-';i++) {
+      if (strcmp(argv[i], "-v") == 0)
+         verbose=1;
+   }
+   if (i != argc-1) {
+      fprintf(stderr, "usage: %s [-v] script\n", argv[0]);
+      return(0);
+   }
+
+   scriptName=argv[i];
+   script=fopen(scriptName, "r");
+   if (script == NULL) {
+      perror(scriptName);
+      return(0);
+   }
+   return(1);
+}
+
+
+// runs the script named on the command line (see pcbsim.c)
+int simRunScript(int argc, char *argv[]) {
+   if (!openScript(argc, argv))
+      return(2);
+
+   simInit();
+   firmware_main();   // never returns, the end of the script ends the run
+   return(0);
+}
+
+
+void simServe(int in, int out, int khz) {
+   serveIn=in;
+   serveOut=out;
+   bitCycles=SIM_CLOCK/4/(khz*1000UL);
+   simMasterNext=(uint64_t)BOOT_MS*1000*SIM_CYCLES_PER_US;   // like the scripts' wait 200
+
+   simInit();
+   firmware_main();   // never returns, the end of the pipe ends the run
+}
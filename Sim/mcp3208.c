@@ -0,0 +1,144 @@
+// MCP3208 model on the bit-banged SPI pins (mode 0,0)
+//
+// After CS falls the converter waits for a start bit on DIN, then takes
+// SGL/DIFF, D2, D1 and D0 on the next rising edges of CLK. The input is
+// sampled there, a null bit is put on DOUT on the falling edge of the
+// following clock, then B11..B0, one per falling edge. DOUT floats
+// (reads 1) before the null bit and while CS is high.
+//
+// Clock high and low times and the CS high time between conversions are
+// checked against the datasheet (2.7V limits when MCP3208_VDD_2V7 is
+// defined, as for the driver). So is the driver's frame: CS low for 24
+// clocks with the start bit on the 6th, so that B0 comes out on the last
+// one. Any of these counts in simMcpErrors().
+
+#include "sim.h"
+
+#ifdef MCP3208_VDD_2V7
+#define MCP_T_HILO_NS  500
+#else
+#define MCP_T_HILO_NS  250
+#endif
+#define MCP_T_CSH_NS   500
+
+#define MCP_FRAME_CLOCKS 24
+#define MCP_START_CLOCK  6
+
+static uint16_t inputs[8];          // counts, 0-4095
+static int lastClk, lastCs=1, started, edges, dout=1;
+static int clocks, startClock;      // rising edges since CS fell
+static uint8_t config;
+static uint16_t sample;
+static uint64_t lastEdge, csRise;
+
+static unsigned long conversions, timingViolations, badFrames;
+
+
+void simMcpSetInput(int ch, uint16_t value) {
+   inputs[ch & 7]=value > 4095 ? 4095 : value;
+}
+
+
+static uint16_t convert(uint8_t cfg) {
+   int plus, minus;
+
+   if (cfg & 0x08)                  // single ended
+      return(inputs[cfg & 7]);
+
+   plus=(cfg & 6) | (cfg & 1);      // pair: even/odd, D0 swaps the inputs
+   minus=plus ^ 1;
+   if (inputs[plus] <= inputs[minus])
+      return(0);
+   return(inputs[plus]-inputs[minus]);
+}
+
+
+static void checkTime(uint64_t since, unsigned long ns) {
+   if ((simCycles-since)*SIM_NS_PER_CYCLE < ns)
+      timingViolations++;
+}
+
+
+// called by hal.c whenever a pin may have changed
+void simMcpPins(void) {
+   int cs, clk, din;
+
+   cs=simPinLevel(BOARD_MCP_CS) != 0;      // floating counts as high
+   clk=simPinLevel(BOARD_MCP_CLK) == 1;
+   din=simPinLevel(BOARD_MCP_DIN) == 1;
+
+   if (cs) {
+      if (!lastCs) {
+         csRise=simCycles;
+         // CS low without a clock (the pin before adc_init()) is no frame
+         if (clocks != 0 && (clocks != MCP_FRAME_CLOCKS || startClock != MCP_START_CLOCK))
+            badFrames++;
+      }
+      lastCs=1;
+      started=0;
+      dout=1;
+      lastClk=clk;
+      return;
+   }
+
+   if (lastCs) {                    // CS has just fallen
+      checkTime(csRise, MCP_T_CSH_NS);
+      lastCs=0;
+      started=0;
+      clocks=0;
+      startClock=0;
+   }
+
+   if (clk && !lastClk) {           // rising edge: DIN is latched
+      checkTime(lastEdge, MCP_T_HILO_NS);
+      lastEdge=simCycles;
+      clocks++;
+
+      if (!started) {
+         if (din) {
+            started=1;
+            startClock=clocks;
+            edges=0;
+            config=0;
+         }
+      } else {
+         edges++;
+         if (edges <= 4)
+            config=(config << 1) | din;
+         if (edges == 4) {
+            sample=convert(config);
+            conversions++;
+         }
+      }
+   } else if (!clk && lastClk) {    // falling edge: DOUT changes
+      checkTime(lastEdge, MCP_T_HILO_NS);
+      lastEdge=simCycles;
+
+      if (started) {
+         if (edges == 5)
+            dout=0;                   // null bit
+         else if (edges >= 6 && edges <= 17)
+            dout=(sample >> (17-edges)) & 1;
+         else if (edges > 17)
+            dout=0;
+      }
+   }
+
+   lastClk=clk;
+}
+
+
+int simMcpDout(void) {
+   return(dout);
+}
+
+
+unsigned long simMcpErrors(void) {
+   return(timingViolations + badFrames);
+}
+
+
+void simMcpStats(FILE *f) {
+   fprintf(f, "mcp3208   %lu conversions, %lu timing violations, %lu bad frames\n",
+           conversions, timingViolations, badFrames);
+}
@@ -0,0 +1,7 @@
+// Host simulator of the display module (see master.c for the scripts)
+
+#include "sim.h"
+
+int main(int argc, char *argv[]) {
+   return(simRunScript(argc, argv));
+}
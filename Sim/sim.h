@@ -0,0 +1,74 @@
+// Host simulator of the LCD display module: shared declarations
+//
+// hal.c      the PIC: simulated time, pins, timers, interrupts and the
+//            MSSP in i2c slave mode
+// lcd.c      HD44780 model on port B and RS/RW/EN
+// mcp3208.c  MCP3208 model on the bit-banged SPI pins
+// master.c   scriptable i2c master (the gogo board), or one serving the
+//            bench in ../Host over a pipe
+// pcbsim.c   main()
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "ccs.h"
+#include "16F886.H"
+
+#ifndef SIM_CLOCK
+#define SIM_CLOCK 20000000
+#endif
+#define SIM_CYCLES_PER_US  (SIM_CLOCK/4000000)
+#define SIM_NS_PER_CYCLE   (4000000000UL/SIM_CLOCK)
+
+// board wiring (see Design/ADC12.DSN)
+#define BOARD_LCD_RS    PIN_C5
+#define BOARD_LCD_RW    PIN_C6
+#define BOARD_LCD_EN    PIN_C7     // data on port B
+#define BOARD_MCP_CLK   PIN_A5
+#define BOARD_MCP_DOUT  PIN_C0
+#define BOARD_MCP_DIN   PIN_C1
+#define BOARD_MCP_CS    PIN_C2
+#define BOARD_INT_OUT   PIN_A0     // open drain, pulled up on the master side
+
+// hal.c
+extern uint64_t simCycles;
+void simInit(void);
+void simCharge(unsigned long cycles);
+int simPinLevel(int pin);          // 1/0 driven by the PIC, -1 floating
+uint8_t simPortOut(int port);      // latch of a port
+int simIntEnabled(long which);     // INT_xxx is enabled
+void simPrintStats(FILE *f);
+
+// MSSP in i2c slave mode, as seen by the master
+extern uint8_t simI2cAddress;               // from the firmware's #use i2c
+#define SSP_NACK  0
+#define SSP_ACK   1
+int simSspAddress(uint8_t address);         // start + address byte
+int simSspWrite(uint8_t value);             // data byte from the master
+int simSspClockHeld(void);                  // the slave stretches SCL
+uint8_t simSspRead(int ack);                // data byte to the master
+
+// lcd.c
+void simLcdPins(void);
+int simLcdDrivesBus(uint8_t *value);
+void simLcdRow(int row, char text[17]);
+void simLcdPrint(FILE *f);
+void simLcdPrintCgram(FILE *f);
+void simLcdStats(FILE *f);
+
+// mcp3208.c
+void simMcpPins(void);
+int simMcpDout(void);
+void simMcpSetInput(int ch, uint16_t value);
+void simMcpStats(FILE *f);
+unsigned long simMcpErrors(void);
+
+// master.c
+extern uint64_t simMasterNext;     // time of the master's next bus event
+void simMasterRun(void);
+int simRunScript(int argc, char *argv[]);
+void simServe(int in, int out, int khz);   // see master.c
+
+#endif
@@ -41,11 +41,15 @@
 //*
 
 #define DEBUG_ON 0      // 1 = debug enabled -> will show error codes on the lcd screen
+#define LCD_BUSY_FLAG 1 // 1 = poll the lcd busy flag (needs PIN_RW), 0 = fixed 50 usec strobes
+#define STATS_ON 1      // 1 = keep the performance counters (see stats.c)
+#define LCD_GEOMETRY LCD_16X2  // LCD_16X2, LCD_20X4 or LCD_40X2 (see lcdGeometry.c)
 
 
 #include <16F886.H>
 
 
+#use fast_io(A)
 #use fast_io(C)
 
 
@@ -54,41 +58,48 @@
 #define PIN_EN PIN_C7   // Enable signal
 #define PIN_RS PIN_C5   // register selection (H=data register, L=instruction register)
 #define PIN_RW PIN_C6   // Read/Write selection (H=Read, L=Write)
+#define PIN_INT_OUT PIN_A0   // open drain "ADC value changed" line to the master
 
 
 #define T1_COUNTER 54000
 
-//command
-// The first 5 commands are compatible with both the 7-segment and lcd character displays
-#define DISPLAY_CMD_PING  1
-#define DISPLAY_VALUE 2
-#define DISPLAY_SHORT_TEXT   3     // shows a 4 letter text. This is here to provide compatibility with the 7-segment display
-#define DISPLAY_UPDATE_SENSORS 4
-#define DISPLAY_LONG_TEXT 5
-
-// These commands are specific to the LCD character display
-#define CLEAR 6
-#define GETPOS 7
-#define SETPOS 8
-#define HIDECUR 9
-#define SHOWCUR 10
+#define LCD_BUSY_TIMEOUT 2000   // busy flag polls (~1.6 usec each) before giving up
+
+// Time updateScreen() may spend drawing per Timer1 tick. It is measured
+// with the 8 bit Timer0 (3.2 usec per count), which wraps every 256
+// counts. The budget is checked once per character, so it can be overrun
+// by a character plus the interrupts that came in meanwhile. Half the
+// range is left for that, otherwise a wrap makes the elapsed time look
+// short and the drawing goes on.
+#define LCD_FLUSH_BUDGET_US 300
+#define LCD_FLUSH_BUDGET ((LCD_FLUSH_BUDGET_US*5)/16)
+
+#if LCD_FLUSH_BUDGET > 127
+#error LCD_FLUSH_BUDGET_US is too long for the 8 bit Timer0
+#endif
+
+#define LCD_POS_UNKNOWN 0xFF    // the lcd cursor must be set before the next write
+
+#define ADC_DEFAULT_PERIOD 61   // Timer0 ticks (819.2 usec) -> about 20 samples/sec
+
+// The i2c commands are listed in protocol.def
 
 #define NOOP 99
 
+// What main() shows on the screen (REG_VIEW register)
+#define VIEW_TEXT 0     // only the text sent by the master
+#define VIEW_ADC  1     // ADC dashboard, see showAdcView()
+#define VIEW_BARS 2     // ADC bar graphs and sparklines, see barView.c
+
+#define ADC_VIEW_CHANNELS 4
+
 //STAT
 #define WAIT_ADDRESS 0
 #define WAIT_CMD 1
-#define WAIT_POSITION 2
-#define WAIT_CHARACTOR 3
-#define SEND_POSITION 4
-#define WAIT_VALUE_HIGH_BYTE 5
-#define WAIT_VALUE_LOW_BYTE 6
-#define READY_FOR_SENSOR_HI      7
-#define READY_FOR_SENSOR_LOW     8
-#define WAIT_SHORT_TEXT1      9
-#define WAIT_SHORT_TEXT2      10
-#define WAIT_SHORT_TEXT3      11
-#define WAIT_SHORT_TEXT4      12
+#define CMD_ARGS 2            // receiving the fixed arguments of a command
+#define CMD_PAYLOAD 3         // receiving its payload
+#define WAIT_GROUP 4          // general call: waiting for the group byte
+#define CMD_SKIP 5            // ignoring the rest of the transaction
 
 // Error codes
 #define ERR_UNKNOWN_COMMAND 0    // unknown I2C command
@@ -99,18 +110,27 @@
 #bit SSPEN = 0x14.5
 #bit SSPOV = 0x14.6
 #bit WCOL  = 0x14.7
+#bit CKP   = 0x14.4   // 0 = SCL held low
+#bit SEN   = 0x91.0   // clock stretching after every received byte
+#bit GCEN  = 0x91.7   // answer the general call address too
 
 #fuses HS,NOWDT,NOPROTECT, BROWNOUT, PUT, NOMCLR
 #use i2c(SLAVE, SDA=PIN_C4, SCL=PIN_C3, address=I2C_ADDRESS, FORCE_HW)
 #use delay (clock=20000000)
 
-#include <stdlib.H>
+#include <formatDecimal.c>
+#include <lcdGeometry.c>
+#include <stats.c>
 #include <myMCP3208.c>
+#include <adcScheduler.c>
+
+#priority ssp, rtcc, timer1
 
 //#use rs232(baud=9600, xmit=PIN_C0,rcv=PIN_C1, FORCE_SW)  // debugging purposes
 
 
 void resetI2C();
+void waitLCDReady();
 void submit();
 void type(int code);
 void fillBlankSensorsWithDefaultValue(void);
@@ -124,6 +144,16 @@ int getPosition();
 void showError(int errCode, int data);
 void init();
 void updateScreen();
+void drawAdcViewLabels();
+void showAdcView();
+void showBarView();
+int1 takeViewChanged(int mode);
+void runCommands();
+void marqueeWrite(int addr, char c, int n);
+int1 marqueeReady();
+int1 marqueePad(int row, int col);
+void scrollTo(int shift);
+void marqueeClear();
 void main();
 
 //static int setCursor =0; 
@@ -133,45 +163,47 @@ int inputCursor=0; //input cursor position
 
 
 static int slaveState = WAIT_ADDRESS; // start state
-int input = 0;
 int cmd =NOOP;
-int gblDisplayBufferIndex=0;  
 int gblDisplayModuleCursorPos=0;
+int gblLcdColumnsLeft=0;     // characters the lcd can still take on the current row
 int1 gblTimeToUpdateScreen=0;  // flag to indicate when to update the screen
 
-char curText[0x21]="                                ";
-int gblNewLCDPos =0;
-
-int16 gblDisplayValue=0;
-char valueBuffer[6]="     ";  // buffer to hold the text version of the received 16 bit display value
+char curText[LCD_CELLS+1];   // the screen, row after row (see lcdGeometry.c)
 
 /// varialbes used to receive sensor values from the gogo board
-int gblSensorBufferHi;
-int gblSensorBufferLow;
 int16 gblSensorValues[8];
 
 int gblSensorTimeout = 0;
 int gblUpdatedSensors = 0;  // keeps log of which sensors values were received
 int gblLastSensorReceived; // logs the latest sensor port number received
 
-int32 gblDirtyBits = 0xffffffff;  // flags the characters that have changed
+int gblViewMode = VIEW_ADC;
+int1 gblViewChanged = 1;  // main() has to redraw the view labels
+
+const char ADC_VIEW_LABELS[33] = "A0=      A1=    A2=      A3=    ";  // 2 rows of 16
+const int ADC_VIEW_DIGITS[ADC_VIEW_CHANNELS] = {LCD_CELL(0,3), LCD_CELL(0,12), LCD_CELL(1,3), LCD_CELL(1,12)};  // first digit of each channel
 
-// variables used to tranform int16 into a string.
-int tenThousands;
-int thousands;
-int hundreds;
-int tens;
-int ones;
+int gblRegPointer=0;      // current register map address (auto-increments)
+int1 gblReadRegisters=0;  // i2c reads return registers instead of the cursor position
+int1 gblReadStream=0;     // i2c reads return the ADC sample stream
+int1 gblBroadcast=0;      // the transaction is a general call (see protocol.c)
+int gblGroup=0;           // general call group of the module, 0 = none
+
+#include <commandQueue.c>
+#include <marquee.c>
+#include <registers.c>
+#include <adcStream.c>
+#include <sensorFrame.c>
+#include <protocol.c>
+#include <barView.c>
 
 
 
 #INT_SSP
 void ssp_interrupt()
 {
-   int i;
    int i2cState;
-   
-   int sensorPort;
+   int address;
    
    //disable_interrupts(GLOBAL);
    
@@ -189,263 +221,85 @@ void ssp_interrupt()
    //             pre-load the transmit buffer for the next transation (the next I2C
    //             read performed by master will read this byte).
 
+   statIsrBegin();
+
+   // a byte that came while SSPBUF was still full has been NACKed. The
+   // MSSP NACKs every byte after it too until SSPOV is cleared
+   if (SSPOV) {
+      statCount(gblStatOverruns);
+      SSPOV = 0;
+   }
+   if (WCOL) {
+      statCount(gblStatCollisions);
+      WCOL = 0;
+   }
+
    i2cState = i2c_isr_state();
 
    if (i2cState == 0) {  // address match with bit 0 clear (gogo wants to send data).
+      address=I2C_ADDRESS;
       if (i2c_poll())
-         i2c_read();  // remove the device address in the rx buffer
+         address=i2c_read();  // remove the device address in the rx buffer
 
-      // if wrong state -> there must have been an error in the i2c comm
-      // reset i2c
-      if (slaveState != WAIT_ADDRESS) {
+      // if the previous command was not complete there must have been
+      // an error in the i2c comm -> reset i2c
+      if (!protocolEnd()) {
          resetI2C();
 
-         showError(ERR_WRONG_STATE, slaveState);
-         output_high(PIN_C1);
+         reportError(ERR_WRONG_STATE, gblCmd);
+         statCount(gblStatWrongState);
 
-         slaveState = WAIT_ADDRESS; // reset the state
-         //enable_interrupts(GLOBAL);
+         releaseClock();
+         statIsrEnd();
          return;
-         
       }
 
-      slaveState=WAIT_CMD;     //device moves into command mode
+      gblBroadcast=(address == 0);
+      if (gblBroadcast)
+         slaveState=WAIT_GROUP;
+      else
+         slaveState=WAIT_CMD;     //device moves into command mode
 
 
    } else if (i2cState < 0x80) { // gogo has sent a byte
 
       if (i2c_poll()) {
-         input=i2c_read();
-         
+         protocolByte(i2c_read());
       } else {
          /// this case should never happen
-         //enable_interrupts(GLOBAL);
+         releaseClock();
+         statIsrEnd();
          return;
       }
 
-      switch(slaveState)
-      {
-         //case WAIT_ADDRESS:
-         case WAIT_CMD:
-               switch(input)
-               {
-                  case DISPLAY_CMD_PING:  // just a ping do nothing.
-                     slaveState = WAIT_ADDRESS;
-                     break;
-               
-                  case CLEAR:
-                     clearScreen();
-                     slaveState = WAIT_ADDRESS;
-                     break;
-                  
-                  case DISPLAY_VALUE:
-                     slaveState = WAIT_VALUE_HIGH_BYTE;
-                     break;
-                  
-                  case DISPLAY_SHORT_TEXT:
-                     output_high(PIN_C2);
-
-                     slaveState = WAIT_SHORT_TEXT1;
-                     output_low(PIN_C2);
-                     break;
-                     
-                  case DISPLAY_LONG_TEXT:
-                     slaveState = WAIT_CHARACTOR;
-                     break;
-                  
-                  case SETPOS: 
-                     slaveState = WAIT_POSITION;
-                     break; 
-                  
-                  case GETPOS:
-                     //special case this op will not be invoked here
-                     //check I2C status instead 
-                     //so the code is in  if (i2cStatus == 0x80) below
-                     break;       
-                  
-                  case HIDECUR:
-                     hideCursor();
-                     slaveState = WAIT_ADDRESS;
-                     break;
-                  
-                  case SHOWCUR:
-                     showCursor();
-                     slaveState = WAIT_ADDRESS;
-                     break;
-
-                  case DISPLAY_UPDATE_SENSORS:
-                     
-                     slaveState = READY_FOR_SENSOR_HI; //first step of sensor update routine
-                     break;
-                  
-                  default:      
-                     // unknown command
-                     showError(ERR_UNKNOWN_COMMAND,  input );
-                     slaveState = WAIT_ADDRESS;
-                     break;
-               }
-            
-               break;
-         
-         case WAIT_VALUE_HIGH_BYTE:
-               gblDisplayValue=input << 8;
-               slaveState = WAIT_VALUE_LOW_BYTE;                 
-               break;
-
-         case WAIT_VALUE_LOW_BYTE:
-         
-
-               gblDisplayValue += input;
-
-               // convert int16 to string
-               
-               // this whole process takes about 300 uSec (on a 20MHz 16F886)
-               // The I2C Master must make sure not to 
-               // send any I2C commands too fast or it will
-               // cause an overrun error.
-               sprintf(valueBuffer,"%Lu",gblDisplayValue);
-
-               for (i=0;i<5;i++) {
-                  if (valueBuffer[i] == '\0') break;  // some numbers have less than 5 digits
-                  curText[inputCursor]=valueBuffer[i];
-                  
-
-                  bit_set(gblDirtyBits, inputCursor);
-                  inputCursor= inputCursor==31?0:inputCursor+1; // wrap position if need be
-                  
-                  ////setPosition(inputCursor);
-               }
-
-
-
-               triggerScreenUpdate();
-               slaveState = WAIT_ADDRESS;
-        
-               break;
-         
-         case WAIT_POSITION:
-               
-               gblNewLCDPos=input;
-               if (gblNewLCDPos>0 ) gblNewLCDPos--;  // make the position a 1's based (first position is 1 not 0)
-               if( gblNewLCDPos>32) gblNewLCDPos=0;
-                              
-               ///outputCursor=gblNewLCDPos;
-               inputCursor=gblNewLCDPos;               
-               ////setPosition(gblNewLCDPos);              
-               slaveState = WAIT_ADDRESS;
-               //triggerScreenUpdate();
-//               printf("%c",inputCursor);
-      
-               break;
-
-         // =================================================
-         // Display 4 character Text. This is here just to
-         // provide compatibility with the 7-segment display module
-
-         case WAIT_SHORT_TEXT1:
-               curText[inputCursor] = input;
-               bit_set(gblDirtyBits, inputCursor);
-               inputCursor=inputCursor==31?0:inputCursor+1;
-               slaveState = WAIT_SHORT_TEXT2;
-               break;
-
-         case WAIT_SHORT_TEXT2:
-               curText[inputCursor] = input;
-               bit_set(gblDirtyBits, inputCursor);
-               inputCursor=inputCursor==31?0:inputCursor+1;
-               slaveState = WAIT_SHORT_TEXT3;
-               break;
-
-         case WAIT_SHORT_TEXT3:
-               curText[inputCursor] = input;
-               bit_set(gblDirtyBits, inputCursor);
-               inputCursor=inputCursor==31?0:inputCursor+1;
-               slaveState = WAIT_SHORT_TEXT4;
-               break;
-
-         case WAIT_SHORT_TEXT4:
-               curText[inputCursor] = input;
-               bit_set(gblDirtyBits, inputCursor);
-               inputCursor=inputCursor==31?0:inputCursor+1;
-               triggerScreenUpdate();
-               slaveState = WAIT_ADDRESS;
-               break;
-
-         // =======================================================
-         // Display text
-         
-         case WAIT_CHARACTOR:
-
-               if(input!='\0'){
-                  curText[inputCursor]=input;
-                  bit_set(gblDirtyBits, inputCursor);
-                  inputCursor=inputCursor==31?0:inputCursor+1;
-                  ////setPosition(inputCursor);
-                  slaveState = WAIT_CHARACTOR;               
-               }  
-               else{
-               triggerScreenUpdate();
-               slaveState = WAIT_ADDRESS;
-               }
-               break;      
-
-         //////////////////////////////////////////////////////////////////////////
-         //
-         //   Receive Sensor Values from the GoGo Board
-         //
-         //////////////////////////////////////////////////////////////////////////
-         
-         
-         case READY_FOR_SENSOR_HI:
-            gblSensorBufferHi = input;
-            slaveState = READY_FOR_SENSOR_LOW;
-            break;
-
-         case READY_FOR_SENSOR_LOW:
-            
-            gblSensorBufferLow = input;
-            
-            sensorPort = gblSensorBufferHi >> 5;   // the 3 MSBs are the sensor port ID
-            
-            // combine the two bytes into one 16 bit sensor value
-            // and store the sensor value in a global buffer
-            gblSensorValues[sensorPort] = ((gblSensorBufferHi & 0b00000011)<<8) + gblSensorBufferLow;
-            
-            gblSensorTimeout = 0;  // reset the time-out counter
-            
-            // We fill in the sensors that were not sent with
-            // the default value (1023). This is done to reduce 
-            // the i2c traffic.
-            if (sensorPort <= gblLastSensorReceived) {
-               fillBlankSensorsWithDefaultValue();
-               gblUpdatedSensors = 0; 
-            }
-            gblLastSensorReceived = sensorPort;
-
-            // record the updated sensor so we know the ones that
-            // were not updated. Used in fillDefaultSensorValue()
-            bit_set(gblUpdatedSensors, sensorPort); 
-
-            
-
-            slaveState = WAIT_ADDRESS;
-            
-            break;
-
-         default:
-            showError(ERR_UNKNOWN_STATE,slaveState  );
-            slaveState = WAIT_ADDRESS;
-            break;
-      } //switch state
-
-
-   } else if (i2cState == 0x80 ) { 
-       i2c_write(inputCursor);             
-       slaveState = WAIT_ADDRESS;   
+   } else { // 0x80 - 0xFF: the master reads
+       if (gblReadStream)
+          i2c_write(streamNextByte());
+       else if (gblReadRegisters)
+          i2c_write(regRead(gblRegPointer++));
+       else
+          i2c_write(inputCursor);
+       protocolEnd();
    }
    //else
 
+   if (i2cState < 0x80)
+      releaseClock();   // the reads are released by i2c_write()
+
    //enable_interrupts(GLOBAL);
+   statIsrEnd();
+}
+
+
+// Timer0 overflows every 819.2 usec (20MHz, RTCC_DIV_16) and paces the
+// background ADC acquisition.
+
+#int_rtcc
+void rtcc_isr(void) {
+   statIsrBegin();
+   adcSchedTick();
+   statTick();
+   statIsrEnd();
 }
 
 
@@ -453,24 +307,23 @@ void ssp_interrupt()
 
 #int_timer1     
 void timer1_isr(void) {  
-   
+   statIsrBegin();
    gblTimeToUpdateScreen = 1;  // signals main() to update the screen
    set_timer1(T1_COUNTER);
-
+   statIsrEnd();
 }
 
 
+#inline
 void triggerScreenUpdate() {
-   // may need to set a flag so that we don't re-trigger while
-   // the previous update has not completed
-
-   gblDisplayBufferIndex=0;
-   
-//   gblNeedToUpdateScreen=1;  // this flag garantees that the 
+   // updateScreen() turns Timer1 off again once nothing is dirty
    enable_interrupts(INT_TIMER1);
 }
 
 void resetI2C() {
+         if (SSPOV) statCount(gblStatOverruns);
+         if (WCOL)  statCount(gblStatCollisions);
+
          // clear the error flag registers and re-enable the i2c bus
          SSPEN = 0;   // disable i2c
          SSPOV = 0;   // clear the receive overflow flag
@@ -480,6 +333,46 @@ void resetI2C() {
 
 }
 
+#if LCD_BUSY_FLAG
+
+// Wait until the lcd has finished the previous instruction by reading the
+// busy flag (D7 with RS low and RW high). This is done before each write
+// instead of after it, so the PIC does not wait while the lcd is busy.
+// Gives up after LCD_BUSY_TIMEOUT polls so a missing display cannot hang
+// the module.
+void waitLCDReady() {
+   int16 n;
+   int1 busy;
+
+   output_low(PIN_RS);
+   input_b();              // release the data bus before the lcd drives it
+   output_high(PIN_RW);
+
+   for (n=LCD_BUSY_TIMEOUT; n!=0; n--) {
+      output_high(PIN_EN);
+      delay_cycles(1);     // data is valid 160 nsec after EN rises
+      busy=input(PIN_B7);
+      output_low(PIN_EN);
+      if (!busy) break;
+   }
+
+   output_low(PIN_RW);
+}
+
+void submit(){
+
+   // the lcd was ready before the write, only the minimum enable pulse
+   // width (230 nsec) is needed
+   output_high(PIN_EN);
+   delay_cycles(2);
+   output_low(PIN_EN);
+}
+
+#else
+
+void waitLCDReady() {
+}
+
 void submit(){
 
    output_high(PIN_EN);
@@ -487,15 +380,21 @@ void submit(){
    output_low(PIN_EN);
 }
 
+#endif
+
 void type(int text){ // convert a charactor to ascii
 
    //show a char on LCD
+   waitLCDReady();
    output_high(PIN_RS);
    if (text=='\0') { text = ' '; }
    output_b(text);
    submit();   
    output_low(PIN_RS); 
+   statCount(gblStatChars);
    gblDisplayModuleCursorPos++;  // update var that tracks the display cursor pos
+   if (--gblLcdColumnsLeft == 0)  // the lcd does not move to the next line by itself
+      gblDisplayModuleCursorPos = LCD_POS_UNKNOWN;
    
    //position updating
    ///outputCursor++;
@@ -524,9 +423,11 @@ void fillBlankSensorsWithDefaultValue(void) {
 
 
 void clearScreen() {
-  inputCursor=0;
-  strcpy(curText,"                                ");
-  gblDirtyBits=0xffffffff;  // set all 32 bits as dirty
+  int i;
+
+  for (i=0;i<LCD_CELLS;i++)
+     curText[i]=' ';
+  setAllDirty();
   triggerScreenUpdate();
 }
 
@@ -536,19 +437,21 @@ void showError(int errCode, int data) {
    // todo: show error message on the screen
    clearScreen();
    sprintf(curText, "Error #%u, %u", errCode, data);
-   gblDirtyBits=0xffffffff;  // set all 32 bits as dirty
+   setAllDirty();
    triggerScreenUpdate();
 
 
 }
 
 void showCursor(){
+   waitLCDReady();
    output_low(PIN_RS);
    output_b(0x0F);
    submit();
 }
 
 void hideCursor(){
+   waitLCDReady();
    output_low(PIN_RS);
    output_b(0x0C);
    submit();
@@ -556,10 +459,21 @@ void hideCursor(){
 
 
 void setPosition(int pos){
+   int row, col;
+
+   row=0;
+   col=pos;
+   while (col >= LCD_COLS) {
+      col-=LCD_COLS;
+      row++;
+   }
+
+   waitLCDReady();
    output_low(PIN_RS);
-   output_b(0x80 + 0x40 * !!( pos & 0x10 ) + ( pos & 0x0F ));
+   output_b(0x80 | (LCD_ROW_ADDR[row] + col));
    submit();
    gblDisplayModuleCursorPos = pos;   // update variable that tracks the display cursor
+   gblLcdColumnsLeft = LCD_COLS-col;
 }
 
 int getPosition() {
@@ -567,13 +481,30 @@ int getPosition() {
 }
 
 void twoDisplay(){
+   waitLCDReady();
+   output_low(PIN_RS);
    output_b(0x38);
    submit();
 }
 
 void init(){
-   output_low(PIN_C2);   // debug pin
+#if LCD_BUSY_FLAG
+   // The PUT fuse already keeps the PIC in reset for 72 ms after power up,
+   // more than the 40 ms the lcd needs. Initialise by instruction: the busy
+   // flag cannot be read until function set has been sent three times.
+   output_b(0x38);
+   output_low(PIN_EN);
+   output_low(PIN_RW);
+   output_low(PIN_RS);
+   submit();
+   delay_ms(5);
+   submit();
+   delay_us(100);
+   submit();
 
+   twoDisplay();
+   hideCursor();
+#else
    delay_ms(100);
    output_b(0x00);
    output_low(PIN_EN);
@@ -581,6 +512,7 @@ void init(){
    output_low(PIN_RS);
    hideCursor();
    twoDisplay();
+#endif
 
 //!   setPosition(1);
 //!   type('G');
@@ -606,11 +538,12 @@ void init(){
 
 
    setPosition(0);
-   triggerScreenUpdate();
+   clearScreen();
+   marqueeClear();   // the off-screen DDRAM is not cleared at power up
 
    setup_adc_ports(NO_ANALOGS);
    setup_adc(ADC_OFF);
-   setup_counters(RTCC_INTERNAL,RTCC_DIV_256);
+   setup_counters(RTCC_INTERNAL,RTCC_DIV_16);
    setup_timer_1(T1_INTERNAL|T1_DIV_BY_1);
 
    set_timer1(T1_COUNTER);
@@ -620,126 +553,159 @@ void init(){
    enable_interrupts(GLOBAL);   
 
    resetI2C();    // clear the i2c circuity
+   SEN = 1;       // hold SCL after each byte until it has been handled
+   GCEN = 1;      // general calls, see protocol.c
 
 
 }
 
 
-// update 1 character on the screen. 
+// Draw the dirty characters. Only the groups of 8 cells flagged in
+// gblDirtyGroups are scanned. Consecutive dirty characters on a row are
+// drawn as one run: a single DDRAM address followed by the characters,
+// using the lcd's address auto-increment. Drawing stops when
+// LCD_FLUSH_BUDGET is used up and carries on at the next Timer1 tick.
+// Nothing is drawn while the master builds a frame (see commandQueue.c).
+// Timer1 is stopped once the screen is clean.
 
 void updateScreen() {
+   int16 groups;
+   int g, bit, pos, start;
 
-   
-   if(gblDisplayBufferIndex==32){  // we have updated all the characters
-      disable_interrupts(INT_TIMER1);
-   }
-   else {
+   if (gblFrameOpen)
+      return;   // COMMIT_FRAME triggers the update again
 
-      // if current char has changed -> display it
-      if (bit_test(gblDirtyBits, gblDisplayBufferIndex)) {
-         bit_clear(gblDirtyBits, gblDisplayBufferIndex);
-         
-         // if the display's screen cursor does not match the buffer index
-         // then we have to update the cursor position.
-         if (gblDisplayBufferIndex != getPosition()) {
-            setPosition(gblDisplayBufferIndex);
+   start=get_timer0();
+   groups=gblDirtyGroups;
+
+   for (g=0; groups!=0; g++, groups>>=1) {
+      if (!bit_test(groups, 0)) continue;
+
+      // cleared first: a character dirtied by the i2c interrupt while
+      // the group is drawn sets it again
+      bit_clear(gblDirtyGroups, g);
+
+      pos=g << 3;
+      for (bit=0; bit<8; bit++, pos++) {
+         if (!bit_test(gblDirtyCells[g], bit)) continue;
+
+         // a frame opened meanwhile has to wait for COMMIT_FRAME too
+         if ((int)(get_timer0()-start) >= LCD_FLUSH_BUDGET || gblFrameOpen) {
+            bit_set(gblDirtyGroups, g);
+            return;  // the rest is drawn on the next tick
          }
 
-         if(gblDisplayBufferIndex==16){  // If at second line -> we must manually set the position
-           setPosition(16);
+         // if the display's screen cursor does not match the buffer index
+         // then a new run starts and we have to update the cursor position.
+         if (pos != getPosition()) {
+            setPosition(pos);
          }
 
-         type(curText[gblDisplayBufferIndex]);
-      } 
-      gblDisplayBufferIndex++;
+         bit_clear(gblDirtyCells[g], bit);
+         type(curText[pos]);
+      }
    }
+
+   // the i2c interrupt may have dirtied more characters in the meantime
+   disable_interrupts(GLOBAL);
+   if (gblDirtyGroups == 0) {
+      disable_interrupts(INT_TIMER1);
+      openHeldFrame();   // a BEGIN_FRAME waiting for this frame to be drawn
+   }
+   enable_interrupts(GLOBAL);
 }
 
-// val_adc is value of analog ot digital from mcp3208
-// line is position of LCD display
-// ch is channel of ADC
-void show_adc(int16 val_adc,int line,int ch){
-         val_adc=val_adc/16;
-         if (gblTimeToUpdateScreen) {
-         gblTimeToUpdateScreen = 0;
-         updateScreen();
+// The labels of view mode have to be drawn. Only taken while mode is still
+// the view: the i2c interrupt may switch to the other one and set
+// gblViewChanged again right after main() has picked the view to show.
+int1 takeViewChanged(int mode) {
+   int1 changed;
+
+   disable_interrupts(GLOBAL);
+   changed=gblViewChanged && gblViewMode == mode;
+   if (changed)
+      gblViewChanged=0;
+   enable_interrupts(GLOBAL);
+   return(changed);
+}
+
+// ADC dashboard: "A0=xxxx  A1=xxxx" on the first line and
+// "A2=xxxx  A3=xxxx" on the second (the rest of the panel stays blank). The labels are written into curText
+// once when the view is entered. After that only the digits that changed
+// are written and marked dirty, so unchanged values cost no LCD time.
+
+void drawAdcViewLabels() {
+   int i;
+
+   for (i=0;i<LCD_CELLS;i++)
+      curText[i]=' ';
+   for (i=0;i<16;i++) {
+      curText[LCD_CELL(0,i)]=ADC_VIEW_LABELS[i];
+      curText[LCD_CELL(1,i)]=ADC_VIEW_LABELS[16+i];
+   }
+   setAllDirty();
+   triggerScreenUpdate();
+}
+
+void showAdcView() {
+   int i,j,pos,fresh;
+   char digits[5];   // formatDecimal() writes 5 digits above 9999
+   int1 changed=0;
+
+   fresh=adcTakeFresh();
+   if (takeViewChanged(VIEW_ADC)) {
+      drawAdcViewLabels();
+      fresh=0xFF;   // the digits are blank
+   }
+
+   for (i=0;i<ADC_VIEW_CHANNELS;i++) {
+      if (!bit_test(fresh, i)) continue;
+
+      formatDecimal(adcLatest12(i), digits, 4, FMT_ZERO_PAD);
+
+      pos=ADC_VIEW_DIGITS[i];
+      for (j=0;j<4;j++) {
+         if (curText[pos] != digits[j]) {
+            curText[pos]=digits[j];
+            setDirty(pos);
+            changed=1;
+         }
+         pos++;
       }
-      
-      setPosition(0);
-      type('I');
-      type('/');
-      type('O');
-      type(' ');
-      type('M');
-      type('o');
-      type('d');
-      type('u');
-      type('l');
-      type('e');
-      type('\0');
-      
-      if(line==1)
-         setPosition(0);
-      else if(line==2)
-         setPosition(16);
-      else if(line==3){
-         setPosition(15);
-         type('\0');}
-       else if(line==4){
-         setPosition(31);
-         type('\0');}
-         
-       
-         
-      type('A');
-      type('D');
-      type('C');
-      type(ch+48);
-      type('\0');
-      type('=');
-      type('\0');
-      
-      
-      
-//!      unsigned char dis1=(val_adc/1000)+48;
-//!      unsigned char dis2=((val_adc%1000)/100)+48;
-//!      unsigned char dis3=(((val_adc%1000)%100)/10)+48;
-//!      unsigned char dis4=(((val_adc%1000)%100)%10)+48;
-      
-      
-      char dis0=(val_adc/10000)+48;
-      char dis1=((val_adc%10000)/1000)+48;
-      char dis2=(((val_adc%10000)%1000)/100)+48;
-      char dis3=((((val_adc%10000)%1000)%100)/10)+48;
-      char dis4=((((val_adc%10000)%1000)%100)%10)+48;
-      
-      
-      type(dis0);
-      type(dis1);
-      type(dis2);
-      type(dis3);
-      type(dis4);
+   }
+
+   if (changed)
+      triggerScreenUpdate();
 }
 
 void main(void) {
-   int16 val_adc=0;
-   int ch[8]={0,1,2,3,4,5,6,7};
    set_tris_c(0b00011001);
    init();  //LCD Init
    adc_init();
+   adcSchedInit();
+
+   // channels 0-3 are shown on the ADC dashboard
+   adcSetPeriod(0, ADC_DEFAULT_PERIOD);
+   adcSetPeriod(1, ADC_DEFAULT_PERIOD);
+   adcSetPeriod(2, ADC_DEFAULT_PERIOD);
+   adcSetPeriod(3, ADC_DEFAULT_PERIOD);
    
    while(1){
    
-   val_adc=read_analog(ch[0]);
-   show_adc(val_adc,2,ch[0]);
-   
-   val_adc=read_analog(ch[1]);
-   show_adc(val_adc,3,ch[1]);
-   
-   val_adc=read_analog(ch[2]);
-   show_adc(val_adc,4,ch[2]);
+      runCommands();   // work queued by the i2c interrupt
+      statSecond();
+      marqueeTick();   // off-screen columns and display shift
+
+      if (gblTimeToUpdateScreen) {
+         gblTimeToUpdateScreen = 0;
+         updateScreen();
+      }
+
+      if (gblViewMode == VIEW_ADC)
+         showAdcView();
+      else if (gblViewMode == VIEW_BARS)
+         showBarView();
 
-   
     }
 }
 
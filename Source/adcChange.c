@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Change detection on the filtered ADC results
+//
+//  For every channel in gblAdcWatchMask, a new result is compared with
+//  the last value reported to the master. When it differs by more than
+//  the channel's deadband, it becomes the new reported value, the channel
+//  bit is set in gblAdcChanged and PIN_INT_OUT is pulled low.
+//
+//  PIN_INT_OUT is used as an open drain line (driven low or floating), so
+//  several modules can share one pulled-up interrupt input on the master.
+//  The 16F886 has no LAT registers: every bsf/bcf on PORTA (the MCP3208
+//  clock on RA5) copies the pin level of the released line back into the
+//  RA0 latch, so the latch is cleared again each time before driving.
+//  The master reads REG_ADC_CHANGED, which clears the mask and releases
+//  the line, and then fetches only the channels that changed.
+//
+////////////////////////////////////////////////////////////////////////////
+
+int gblAdcWatchMask=0;              // channels with change detection
+int gblAdcChanged=0;                // channels that changed since the last read
+int gblAdcDeadband[ADC_CHANNELS];   // allowed change in counts
+int16 gblAdcReported[ADC_SLOTS];    // value the last change was reported with
+
+
+void adcChangeInit() {
+   int ch;
+
+   for (ch=0;ch<ADC_CHANNELS;ch++)
+      gblAdcDeadband[ch]=0;
+
+   output_low(PIN_INT_OUT);
+   output_float(PIN_INT_OUT);    // released
+}
+
+
+void adcSetWatch(int mask) {
+   int ch,s;
+
+   disable_interrupts(INT_RTCC);
+
+   // newly watched channels report their first result (a channel that
+   // gets a slot later does anyway)
+   for (ch=0;ch<ADC_CHANNELS;ch++) {
+      s=gblAdcSlot[ch];
+      if (s != ADC_NO_SLOT && bit_test(mask, ch) && !bit_test(gblAdcWatchMask, ch))
+         gblAdcReported[s]=0xFFFF;
+   }
+   gblAdcWatchMask=mask;
+   gblAdcChanged&=mask;
+
+   enable_interrupts(INT_RTCC);
+}
+
+
+// called from the scheduler tick for every new result of channel ch, s
+// is its slot
+void adcCheckChange(int ch, int s, int16 value) {
+   int16 diff;
+
+   if (!bit_test(gblAdcWatchMask, ch)) return;
+
+   if (value > gblAdcReported[s])
+      diff=value-gblAdcReported[s];
+   else
+      diff=gblAdcReported[s]-value;
+
+   if (diff <= gblAdcDeadband[ch]) return;
+
+   gblAdcReported[s]=value;
+   bit_set(gblAdcChanged, ch);
+   output_low(PIN_INT_OUT);      // the latch may have read back a high
+   output_drive(PIN_INT_OUT);    // pull the line low
+}
+
+
+// called from the i2c interrupt when the master reads the changed mask
+int adcTakeChanged() {
+   int changed;
+
+   changed=gblAdcChanged;
+   gblAdcChanged=0;
+   output_float(PIN_INT_OUT);   // release the line
+   return(changed);
+}
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Per channel filtering of the MCP3208 samples
+//
+//  Every raw sample taken by the scheduler goes through adcFilter() before
+//  it reaches the channel's ring buffer. Each channel has one filter, chosen
+//  with adcSetFilter( channel, config ):
+//
+//    FILTER_NONE           raw 12 bit samples
+//    FILTER_OVERSAMPLE(n)  sums 4^n samples (n = 1 or 2) and outputs one
+//                          12+n bit result per 4^n samples
+//    FILTER_EMA(k)         exponential moving average, y += (x - y) / 2^k
+//                          (k = 1-4), one output per sample
+//
+//  FILTER_MEDIAN can be or'ed to any of them to replace each sample by the
+//  median of the last 3 samples first, which removes single sample spikes.
+//
+//  The results of an oversampling channel are 13 or 14 bits wide (up to
+//  16380) in the ring buffer, the ADC registers and the stream, so the
+//  master gets the extra bits. adcExtraBits() tells how many there are,
+//  the views use adcLatest12() to show the channel on the 12 bit scale.
+//
+//  Each step costs the same few instructions whatever the settings. The
+//  setting is kept for every channel, the filter state (7 bytes) only in
+//  the slots of the channels that are on (see adcScheduler.c).
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define FILTER_NONE           0x00
+#define FILTER_OVERSAMPLE(n)  (0x10 | (n))
+#define FILTER_EMA(k)         (0x20 | (k))
+#define FILTER_MEDIAN         0x80
+
+#define FILTER_TYPE_MASK      0x30
+#define FILTER_TYPE_OVERSAMPLE 0x10
+#define FILTER_TYPE_EMA       0x20
+#define FILTER_PARAM_MASK     0x07
+#define FILTER_PRIMED         6      // bit set once the state holds real samples
+
+#define FILTER_MAX_OVERSAMPLE 2      // 16 samples of 12 bits still fit in an int16
+#define FILTER_MAX_EMA        4      // a 12 bit value << 4 still fits in an int16
+
+int gblFilterCfg[ADC_CHANNELS];
+
+// per slot
+int16 gblFilterAcc[ADC_SLOTS];     // oversampling sum, or the average << k
+int gblFilterCount[ADC_SLOTS];     // samples in the oversampling sum
+int16 gblFilterMedA[ADC_SLOTS];    // the 2 previous samples for the median
+int16 gblFilterMedB[ADC_SLOTS];
+
+
+void adcSetFilter(int ch, int cfg) {
+   int p;
+
+   p=cfg & FILTER_PARAM_MASK;
+   if ((cfg & FILTER_TYPE_MASK) == FILTER_TYPE_OVERSAMPLE && p > FILTER_MAX_OVERSAMPLE)
+      cfg=(cfg & ~FILTER_PARAM_MASK) | FILTER_MAX_OVERSAMPLE;
+   if ((cfg & FILTER_TYPE_MASK) == FILTER_TYPE_EMA && p > FILTER_MAX_EMA)
+      cfg=(cfg & ~FILTER_PARAM_MASK) | FILTER_MAX_EMA;
+
+   disable_interrupts(INT_RTCC);
+   gblFilterCfg[ch]=cfg & ~(1 << FILTER_PRIMED);  // restart from the next sample
+   bit_set(gblAdcFresh, ch);                      // adcLatest12() scales by it
+   enable_interrupts(INT_RTCC);
+}
+
+
+// bits above 12 in the results of the channel
+int adcExtraBits(int ch) {
+   int cfg;
+
+   cfg=gblFilterCfg[ch];
+   if ((cfg & FILTER_TYPE_MASK) == FILTER_TYPE_OVERSAMPLE)
+      return(cfg & FILTER_PARAM_MASK);
+   return(0);
+}
+
+
+// Called from the scheduler tick with a new raw sample of channel ch in
+// *value, s is its slot. Returns 1 when *value holds a new filtered result.
+int1 adcFilter(int ch, int s, int16 *value) {
+   int cfg, p;
+   int16 x, a, b;
+
+   cfg=gblFilterCfg[ch];
+   p=cfg & FILTER_PARAM_MASK;
+   x=*value;
+
+   if (!bit_test(cfg, FILTER_PRIMED)) {
+      gblFilterMedA[s]=x;
+      gblFilterMedB[s]=x;
+      gblFilterCount[s]=0;
+      if ((cfg & FILTER_TYPE_MASK) == FILTER_TYPE_EMA)
+         gblFilterAcc[s]=x << p;    // start the average at the first sample
+      else
+         gblFilterAcc[s]=0;
+      bit_set(gblFilterCfg[ch], FILTER_PRIMED);
+   }
+
+   if (bit_test(cfg, 7)) {   // FILTER_MEDIAN
+      a=gblFilterMedA[s];
+      b=gblFilterMedB[s];
+      gblFilterMedA[s]=b;
+      gblFilterMedB[s]=x;
+
+      if (a > b) {   // swap so that a <= b
+         b=a;
+         a=gblFilterMedA[s];
+      }
+      if (x < a)
+         x=a;
+      else if (x > b)
+         x=b;
+   }
+
+   switch (cfg & FILTER_TYPE_MASK) {
+      case FILTER_TYPE_OVERSAMPLE:
+         gblFilterAcc[s]+=x;
+         if (++gblFilterCount[s] < (1 << (p+p)))
+            return(0);       // not enough samples yet
+         x=gblFilterAcc[s] >> p;
+         gblFilterAcc[s]=0;
+         gblFilterCount[s]=0;
+         break;
+
+      case FILTER_TYPE_EMA:
+         gblFilterAcc[s]=gblFilterAcc[s] - (gblFilterAcc[s] >> p) + x;
+         x=gblFilterAcc[s] >> p;
+         break;
+   }
+
+   *value=x;
+   return(1);
+}
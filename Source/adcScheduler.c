@@ -0,0 +1,337 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Background acquisition scheduler for the 8 MCP3208 channels
+//
+//  adcSchedTick() runs from the Timer0 interrupt (every 819.2 usec with
+//  a 20MHz clock and RTCC_DIV_16). Each channel has its own sample period
+//  counted in these ticks (0 = channel off). Channels that fall due are
+//  queued and converted round robin, at most ADC_CONVERSIONS_PER_TICK per
+//  tick, so a tick never spends more than ~70 usec per conversion in the
+//  interrupt and the sample rates do not depend on what main() is doing.
+//
+//  Each sample goes through the channel's filter (adcFilter.c) and every
+//  result is kept in the channel's ring buffer, the last ADC_RING_SIZE.
+//  When the ring is full the oldest unread sample is overwritten and
+//  gblAdcOverflows is incremented. Results of watched channels are also
+//  checked against their deadband (adcChange.c) to signal the master.
+//
+//  The RAM cannot hold a ring, a schedule and a filter for all 8 channels.
+//  They are kept in ADC_SLOTS slots instead, taken by the channels as they
+//  are turned on. A channel that is turned off keeps its slot and its
+//  samples until another channel needs the slot. A channel without a slot
+//  reads 0.
+//
+//  adcSchedInit()
+//      Clears the buffers and starts the scheduler. Call after adc_init()
+//
+//  ok = adcSetPeriod( channel, ticks )
+//      Sample the channel every 'ticks' Timer0 ticks. 0 turns it off.
+//      Returns 0, and leaves the channel off, while ADC_SLOTS other
+//      channels are on
+//
+//  ticks = adcPeriod( channel )
+//      The channel's period, 0 when it is off
+//
+//  gblAdcTicks
+//      Timer0 ticks since power up (wraps). gblAdcStamp[gblAdcSlot[channel]]
+//      holds the tick at which the channel's last sample was stored
+//
+//  adcSync( ticks )
+//      Sets gblAdcTicks and restarts every channel's period (SYNC command)
+//
+//  gblAdcDiffMask
+//      Channels read in differential mode (see read_analog_scan())
+//
+//  value = adcLatest( channel )
+//      Most recent sample of the channel (safe to call from anywhere).
+//      12 bits, or 13-14 with FILTER_OVERSAMPLE (see adcFilter.c)
+//
+//  value = adcLatest12( channel )
+//      The same scaled to 12 bits (0-4095), for the views
+//
+//  fresh = adcTakeFresh()
+//      Channels whose adcLatest12() may have changed since the last call,
+//      one bit each. The views only redraw these
+//
+//  n = adcAvailable( channel )  /  value = adcPop( channel )
+//      Unread samples in the ring, and removes the oldest one (only when
+//      there is one). Only call these from interrupt context (they are not
+//      guarded against the scheduler tick)
+//
+//  value = adcPrevious( channel )
+//      The sample adcPop() returned last. Gone once the ring is full, same
+//      restriction as above
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define ADC_CHANNELS   8
+#define ADC_SLOTS      4       // channels that can be on at the same time
+#define ADC_NO_SLOT    0xFF
+#define ADC_RING_SIZE  4       // samples kept per channel, must be a power of 2
+#define ADC_RING_MASK  (ADC_RING_SIZE-1)
+
+#define ADC_CONVERSIONS_PER_TICK 1
+
+int gblAdcSlot[ADC_CHANNELS];     // slot of the channel, ADC_NO_SLOT = none
+
+// per slot
+int16 gblAdcRing[ADC_SLOTS][ADC_RING_SIZE];
+int gblAdcHead[ADC_SLOTS];        // next ring entry to be written
+int gblAdcCount[ADC_SLOTS];       // unread samples in the ring
+
+int16 gblAdcPeriod[ADC_SLOTS];     // sample period in ticks (0 = off)
+int16 gblAdcCountdown[ADC_SLOTS];  // ticks left until the next sample
+
+int gblAdcPending=0;     // channels that are due for a conversion
+int gblAdcNextCh=0;      // where the round robin search starts
+int gblAdcOverflows=0;   // unread samples that were overwritten
+int gblAdcMissed=0;      // channels that fell due again before being converted
+int gblAdcDiffMask=0;    // channels read as differential pairs
+int gblAdcFresh=0;       // see adcTakeFresh()
+int16 gblAdcTicks=0;     // Timer0 ticks, time base of the stream timestamps
+int16 gblAdcStamp[ADC_SLOTS];   // tick of the last sample in the ring
+
+#include <adcFilter.c>
+#include <adcChange.c>
+
+
+void adcSchedInit() {
+   int ch,s;
+
+   for (ch=0;ch<ADC_CHANNELS;ch++) {
+      gblAdcSlot[ch]=ADC_NO_SLOT;
+      adcSetFilter(ch, FILTER_NONE);
+   }
+   for (s=0;s<ADC_SLOTS;s++)
+      gblAdcPeriod[s]=0;
+   adcChangeInit();
+
+   enable_interrupts(INT_RTCC);
+}
+
+
+// the channel that has slot s, ADC_CHANNELS when it is free
+int adcSlotOwner(int s) {
+   int ch;
+
+   for (ch=0;ch<ADC_CHANNELS;ch++) {
+      if (gblAdcSlot[ch] == s)
+         break;
+   }
+   return(ch);
+}
+
+
+int1 adcSetPeriod(int ch, int16 ticks) {
+   int s,i,owner;
+
+   disable_interrupts(INT_RTCC);
+
+   s=gblAdcSlot[ch];
+   if (s == ADC_NO_SLOT && ticks != 0) {
+      // a free slot, else one of a channel that is off
+      for (s=0;s<ADC_SLOTS;s++) {
+         if (adcSlotOwner(s) == ADC_CHANNELS)
+            break;
+      }
+      if (s == ADC_SLOTS) {
+         for (s=0;s<ADC_SLOTS;s++) {
+            if (gblAdcPeriod[s] == 0)
+               break;
+         }
+         if (s == ADC_SLOTS) {
+            enable_interrupts(INT_RTCC);
+            return(0);
+         }
+         owner=adcSlotOwner(s);
+         gblAdcSlot[owner]=ADC_NO_SLOT;   // its samples are gone
+         bit_set(gblAdcFresh, owner);
+      }
+
+      gblAdcSlot[ch]=s;
+      bit_set(gblAdcFresh, ch);
+      for (i=0;i<ADC_RING_SIZE;i++)
+         gblAdcRing[s][i]=0;
+      gblAdcHead[s]=0;
+      gblAdcCount[s]=0;
+      bit_clear(gblFilterCfg[ch], FILTER_PRIMED);   // the slot's filter restarts
+      gblAdcReported[s]=0xFFFF;                     // first result is reported
+   }
+
+   if (s != ADC_NO_SLOT) {
+      gblAdcPeriod[s]=ticks;
+      gblAdcCountdown[s]=1;   // first sample on the next tick
+   }
+   if (ticks==0)
+      bit_clear(gblAdcPending, ch);
+
+   enable_interrupts(INT_RTCC);
+   return(1);
+}
+
+
+int16 adcPeriod(int ch) {
+   int s;
+
+   s=gblAdcSlot[ch];
+   if (s == ADC_NO_SLOT)
+      return(0);
+   return(gblAdcPeriod[s]);
+}
+
+
+void adcPush(int s, int16 value) {
+   int head;
+
+   head=gblAdcHead[s];
+   gblAdcRing[s][head]=value;
+   gblAdcHead[s]=(head+1) & ADC_RING_MASK;
+
+   if (gblAdcCount[s]==ADC_RING_SIZE)
+      gblAdcOverflows++;      // the oldest sample has just been overwritten
+   else
+      gblAdcCount[s]++;
+
+   gblAdcStamp[s]=gblAdcTicks;
+}
+
+
+int16 adcLatest(int ch) {
+   int s;
+   int16 value=0;
+
+   disable_interrupts(INT_RTCC);
+   s=gblAdcSlot[ch];
+   if (s != ADC_NO_SLOT)
+      value=gblAdcRing[s][(gblAdcHead[s]-1) & ADC_RING_MASK];
+   enable_interrupts(INT_RTCC);
+
+   return(value);
+}
+
+
+// the extra bits of an oversampling channel are dropped. A sample taken
+// before the filter was changed is clamped to the 12 bit range.
+int16 adcLatest12(int ch) {
+   int16 value;
+
+   value=adcLatest(ch) >> adcExtraBits(ch);
+   if (value > 4095)
+      value=4095;
+   return(value);
+}
+
+
+int adcTakeFresh() {
+   int fresh;
+
+   disable_interrupts(INT_RTCC);
+   fresh=gblAdcFresh;
+   gblAdcFresh=0;
+   enable_interrupts(INT_RTCC);
+
+   return(fresh);
+}
+
+
+int adcAvailable(int ch) {
+   int s;
+
+   s=gblAdcSlot[ch];
+   if (s == ADC_NO_SLOT)
+      return(0);
+   return(gblAdcCount[s]);
+}
+
+
+int16 adcPop(int ch) {
+   int s,tail;
+
+   s=gblAdcSlot[ch];
+   tail=(gblAdcHead[s]-gblAdcCount[s]) & ADC_RING_MASK;
+   gblAdcCount[s]--;
+   return(gblAdcRing[s][tail]);
+}
+
+
+int16 adcPrevious(int ch) {
+   int s;
+
+   s=gblAdcSlot[ch];
+   return(gblAdcRing[s][(gblAdcHead[s]-gblAdcCount[s]-1) & ADC_RING_MASK]);
+}
+
+
+// called from the i2c interrupt (SYNC), the Timer0 interrupt cannot run
+// meanwhile. Modules that get the same general call restart their tick
+// at the same moment: Timer0 is cleared too, so they stay within a few
+// usec of each other. Every channel that is on falls due on the next
+// tick and the round robin starts at channel 0, so they all sample at
+// the same ticks from then on.
+void adcSync(int16 ticks) {
+   int s;
+
+   set_timer0(0);
+   clear_interrupt(INT_RTCC);
+   statIsrBegin();   // the running measurement is lost with Timer0
+
+   gblAdcTicks=ticks;
+   gblAdcPending=0;
+   gblAdcNextCh=0;
+   for (s=0;s<ADC_SLOTS;s++)
+      gblAdcCountdown[s]=1;
+}
+
+
+// called from the Timer0 interrupt
+void adcSchedTick() {
+   int ch,s,n,mask;
+   int16 values[ADC_CONVERSIONS_PER_TICK];
+
+   gblAdcTicks++;
+
+   for (ch=0;ch<ADC_CHANNELS;ch++) {
+      s=gblAdcSlot[ch];
+      if (s != ADC_NO_SLOT && gblAdcPeriod[s]!=0) {
+         if (--gblAdcCountdown[s]==0) {
+            gblAdcCountdown[s]=gblAdcPeriod[s];
+            if (bit_test(gblAdcPending, ch))
+               gblAdcMissed++;
+            bit_set(gblAdcPending, ch);
+         }
+      }
+   }
+
+   // pick the channels to convert, round robin so that a fast channel
+   // cannot starve the others
+   mask=0;
+   for (n=0; n<ADC_CONVERSIONS_PER_TICK && gblAdcPending; n++) {
+      ch=gblAdcNextCh;
+      while (!bit_test(gblAdcPending, ch))
+         ch=(ch+1) & 0x07;
+
+      bit_clear(gblAdcPending, ch);
+      bit_set(mask, ch);
+      gblAdcNextCh=(ch+1) & 0x07;
+   }
+
+   if (mask == 0)
+      return;
+
+   // the scan returns the values lowest channel first
+   n=read_analog_scan(mask, gblAdcDiffMask, values);
+   statAdd(gblStatConversions, n);
+
+   n=0;
+   for (ch=0; mask!=0; ch++, mask>>=1) {
+      if (bit_test(mask, 0)) {
+         s=gblAdcSlot[ch];
+         if (adcFilter(ch, s, &values[n])) {
+            adcPush(s, values[n]);
+            bit_set(gblAdcFresh, ch);
+            adcCheckChange(ch, s, values[n]);
+         }
+         n++;
+      }
+   }
+}
@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Streaming of the ADC ring buffers over a continuous i2c read
+//
+//  After the STREAM command every byte the master reads comes from
+//  streamNextByte(), which drains the channels' ring buffers. Everything
+//  in the rings goes out in one frame with a single header:
+//
+//    seq        frame sequence number, 0-0x7F then wraps
+//    overflows  gblAdcOverflows, a jump means samples were dropped
+//    stamp      2 bytes, high first: Timer0 tick (819.2 usec) at which the
+//               frame started
+//    mask       the channels in the frame, bit 0 = channel 0
+//
+//  followed by, for each channel in mask, lowest first:
+//
+//    age << 2|n-1  n = number of samples (1-4). The last one was stored
+//               age ticks before stamp, a 6 bit signed number: negative
+//               when it came in while the frame was being read, 31 when
+//               it is 31 ticks old or more (the channel's period then
+//               times it). The samples before it are one period apart
+//    deltas     n bytes, each sample minus the one sent before it on that
+//               channel (-127..127), the first one too. A larger step, and
+//               the first sample of a channel after STREAM or after its
+//               ring was full, is sent as STREAM_ESCAPE followed by the
+//               full sample, high byte first. 12 bits, 13-14 for a channel
+//               with FILTER_OVERSAMPLE (see adcFilter.c)
+//
+//  So a sample costs one byte, plus one per channel and five per frame:
+//  a full frame of 4 channels (ADC_SLOTS) carries 16 samples in 25 bytes. The ring
+//  cannot be deeper (RAM), the master should read as seldom as the rings
+//  allow, i.e. every 4 periods of the fastest channel.
+//
+//  When no channel has samples, the master reads STREAM_IDLE (0xFF) where
+//  the next frame would start. A frame cut short by the end of a read
+//  continues with the first byte of the next read, nothing is lost.
+//
+//  Only call streamNextByte() from the i2c interrupt (it pops the rings).
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define STREAM_IDLE      0xFF
+#define STREAM_ESCAPE    0x80
+#define STREAM_SEQ_MASK  0x7F
+#define STREAM_AGE_MAX   31
+
+// next byte of the frame
+#define STREAM_SEQ       0
+#define STREAM_OVERFLOWS 1
+#define STREAM_STAMP_HI  2
+#define STREAM_STAMP_LO  3
+#define STREAM_MASK      4
+#define STREAM_COUNT     5
+#define STREAM_DELTA     6
+#define STREAM_FULL_HI   7
+#define STREAM_FULL_LO   8
+
+// after a sample: the next one, the next channel or the next frame
+#define streamAfterSample() \
+   (gblStreamLeft != 0 ? STREAM_DELTA : gblStreamTodo != 0 ? STREAM_COUNT : STREAM_SEQ)
+
+int gblStreamStep=STREAM_SEQ;
+int gblStreamSeq=0;
+int gblStreamTodo;                // channels of the frame not sent yet
+int gblStreamKnown=0;             // channels the master has a sample of
+int gblStreamCh;                  // channel being sent
+int gblStreamLeft;                // its samples not sent yet
+int16 gblStreamStamp;
+int16 gblStreamPrev;              // last sample sent on gblStreamCh
+int1 gblStreamRef;                // ... and the master has it
+
+
+// called from the i2c interrupt on STREAM: the master starts afresh
+void streamRestart() {
+   gblStreamStep=STREAM_SEQ;
+   gblStreamKnown=0;
+}
+
+
+int streamNextByte() {
+   int ch, n;
+   signed int16 delta;
+
+   switch (gblStreamStep) {
+      case STREAM_SEQ:
+         n=0;
+         for (ch=0;ch<ADC_CHANNELS;ch++) {
+            if (adcAvailable(ch) != 0)
+               bit_set(n, ch);
+         }
+         if (n == 0)
+            return(STREAM_IDLE);
+
+         gblStreamTodo=n;
+         gblStreamStamp=gblAdcTicks;
+         gblStreamStep=STREAM_OVERFLOWS;
+         n=gblStreamSeq;
+         gblStreamSeq=(n+1) & STREAM_SEQ_MASK;
+         return(n);
+
+      case STREAM_OVERFLOWS:
+         gblStreamStep=STREAM_STAMP_HI;
+         return(gblAdcOverflows);
+
+      case STREAM_STAMP_HI:
+         gblStreamStep=STREAM_STAMP_LO;
+         return(make8(gblStreamStamp, 1));
+
+      case STREAM_STAMP_LO:
+         gblStreamStep=STREAM_MASK;
+         return(make8(gblStreamStamp, 0));
+
+      case STREAM_MASK:
+         gblStreamStep=STREAM_COUNT;
+         return(gblStreamTodo);
+
+      case STREAM_COUNT:
+         for (ch=0;!bit_test(gblStreamTodo, ch);ch++)
+            ;
+         bit_clear(gblStreamTodo, ch);
+         gblStreamCh=ch;
+         n=adcAvailable(ch);   // not 0, only the stream pops the rings
+         gblStreamLeft=n;
+
+         // the sample before the oldest one in the ring went out last,
+         // unless the ring is full and it has been overwritten
+         gblStreamRef=bit_test(gblStreamKnown, ch) && n < ADC_RING_SIZE;
+         if (gblStreamRef)
+            gblStreamPrev=adcPrevious(ch);
+
+         delta=gblStreamStamp-gblAdcStamp[gblAdcSlot[ch]];
+         if (delta > STREAM_AGE_MAX)
+            delta=STREAM_AGE_MAX;
+         if (delta < -STREAM_AGE_MAX-1)
+            delta=-STREAM_AGE_MAX-1;
+         gblStreamStep=STREAM_DELTA;
+         return((make8(delta, 0) << 2) | (n-1));
+
+      case STREAM_DELTA:
+         delta=adcPop(gblStreamCh);
+         delta-=gblStreamPrev;
+         gblStreamPrev+=delta;
+         gblStreamLeft--;
+         bit_set(gblStreamKnown, gblStreamCh);
+         if (!gblStreamRef || delta < -127 || delta > 127) {
+            gblStreamRef=1;
+            gblStreamStep=STREAM_FULL_HI;
+            return(STREAM_ESCAPE);
+         }
+         gblStreamStep=streamAfterSample();
+         return(make8(delta, 0));
+
+      case STREAM_FULL_HI:
+         gblStreamStep=STREAM_FULL_LO;
+         return(make8(gblStreamPrev, 1));
+
+      default:   // STREAM_FULL_LO
+         gblStreamStep=streamAfterSample();
+         return(make8(gblStreamPrev, 0));
+   }
+}
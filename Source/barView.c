@@ -0,0 +1,192 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Bar graph view (VIEW_BARS) of ADC channels 0-3
+//
+//  Each channel takes 8 cells, two channels on each of the first two rows:
+//
+//     cell 0     channel number
+//     cells 1-6  horizontal bar, 30 steps (5 pixel columns per cell)
+//     cell 7     sparkline of the last 5 samples (one pixel column each)
+//
+//  The bar uses 4 fixed CGRAM glyphs for the partly filled cell, 0xFF
+//  (full block) and space. A new level only changes the cells between the
+//  old and the new end of the bar, and only those are marked dirty, so a
+//  full scale move costs 6 characters and one DDRAM address on the bus.
+//
+//  Every channel has its own sparkline glyph. The sparkline is swept like
+//  an oscilloscope: each step overwrites one pixel column, so only the
+//  CGRAM rows holding the old and the new pixel of that column are
+//  written. The levels of the 5 columns are kept packed 3 bits each.
+//
+//  The glyphs are written as codes 8-15, which the lcd maps onto CGRAM
+//  0-7 (type() turns code 0 into a space).
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define BAR_CHANNELS     4
+#define BAR_CELLS        6
+#define BAR_STEPS        (BAR_CELLS*5)
+#define BAR_GLYPH        8      // + 0-3: cell with 1-4 columns filled
+#define SPARK_GLYPH      12     // + channel
+#define SPARK_COLUMNS    5
+#define SPARK_PERIOD     244    // Timer0 ticks between sparkline steps (200 ms)
+
+#define LCD_FULL_BLOCK   0xFF
+
+const int BAR_CELL[BAR_CHANNELS] = {LCD_CELL(0,0), LCD_CELL(0,8), LCD_CELL(1,0), LCD_CELL(1,8)};
+
+int16 gblSparkLevels[BAR_CHANNELS];   // 3 bits per pixel column, column 0 lowest
+int gblSparkColumn=0;                 // next column to overwrite
+int16 gblSparkLastTick=0;
+
+
+// CGRAM data is written with RS high like DDRAM data. The lcd address
+// counter is left in CGRAM, so the next character needs a DDRAM address.
+void setCgramAddress(int addr) {
+   waitLCDReady();
+   output_low(PIN_RS);
+   output_b(0x40 | addr);
+   submit();
+   gblDisplayModuleCursorPos = LCD_POS_UNKNOWN;
+}
+
+void writeCgram(int row) {
+   waitLCDReady();
+   output_high(PIN_RS);
+   output_b(row);
+   submit();
+   output_low(PIN_RS);
+}
+
+
+// one pixel row of a sparkline glyph, from the levels of its 5 columns
+int sparkRow(int16 levels, int row) {
+   int c, bits, level;
+
+   level=7-row;    // the top row shows level 7
+   bits=0;
+   for (c=0;c<SPARK_COLUMNS;c++) {
+      bits<<=1;
+      if ((levels & 7) == level)
+         bits|=1;
+      levels>>=3;
+   }
+   return(bits);   // column 0 was shifted furthest left
+}
+
+
+// loads all 8 glyphs and draws the channel numbers
+#inline
+void drawBarView() {
+   int i, row, ch;
+
+   setCgramAddress(0);
+   for (i=0;i<4;i++) {
+      for (row=0;row<8;row++)
+         writeCgram((0x1F << (4-i)) & 0x1F);   // i+1 columns from the left
+   }
+   for (ch=0;ch<BAR_CHANNELS;ch++) {
+      gblSparkLevels[ch]=0;
+      for (row=0;row<8;row++)
+         writeCgram(row == 7 ? 0x1F : 0);
+   }
+   gblSparkColumn=0;
+
+   for (i=0;i<LCD_CELLS;i++)
+      curText[i]=' ';
+   for (ch=0;ch<BAR_CHANNELS;ch++) {
+      curText[BAR_CELL[ch]]='0'+ch;
+      curText[BAR_CELL[ch]+7]=SPARK_GLYPH+ch;
+   }
+   setAllDirty();
+   triggerScreenUpdate();
+}
+
+
+// only the cells whose glyph changes are marked dirty. Returns 1 when
+// there was one
+int1 drawBar(int ch, int level) {
+   int cell, pos, fill;
+   char c;
+   int1 changed=0;
+
+   pos=BAR_CELL[ch]+1;
+   for (cell=0;cell<BAR_CELLS;cell++,pos++) {
+      fill=level;
+      if (fill > 5) fill=5;
+      if (level > 5) level-=5; else level=0;
+
+      if (fill == 0)      c=' ';
+      else if (fill == 5) c=LCD_FULL_BLOCK;
+      else                c=BAR_GLYPH+fill-1;
+
+      if (curText[pos] != c) {
+         curText[pos]=c;
+         setDirty(pos);
+         changed=1;
+      }
+   }
+   return(changed);
+}
+
+
+// puts a new level into the current column of a channel's sparkline
+#inline
+void sparkStep(int ch, int level) {
+   int16 levels;
+   int shift, old;
+
+   levels=gblSparkLevels[ch];
+   shift=gblSparkColumn*3;
+   old=(levels >> shift) & 7;
+   if (old == level)
+      return;
+
+   levels&=~((int16)7 << shift);
+   levels|=(int16)level << shift;
+   gblSparkLevels[ch]=levels;
+
+   setCgramAddress(((SPARK_GLYPH+ch-8) << 3) | (7-old));
+   writeCgram(sparkRow(levels, 7-old));
+   setCgramAddress(((SPARK_GLYPH+ch-8) << 3) | (7-level));
+   writeCgram(sparkRow(levels, 7-level));
+}
+
+
+void showBarView() {
+   int ch, level, fresh;
+   int16 value, now;
+   int1 changed=0;
+   int1 step;
+
+   fresh=adcTakeFresh();
+   if (takeViewChanged(VIEW_BARS)) {
+      drawBarView();
+      fresh=0xFF;   // the bars are empty
+   }
+
+   disable_interrupts(GLOBAL);   // the Timer0 interrupt updates it
+   now=gblAdcTicks;
+   enable_interrupts(GLOBAL);
+   step=(now-gblSparkLastTick >= SPARK_PERIOD);
+   if (step)
+      gblSparkLastTick=now;
+
+   for (ch=0;ch<BAR_CHANNELS;ch++) {
+      value=adcLatest12(ch);   // the levels below assume 0-4095
+
+      if (step)
+         sparkStep(ch, value >> 9);
+
+      if (!bit_test(fresh, ch)) continue;
+      level=(value*15+1024) >> 11;   // 0-4095 -> 0-BAR_STEPS
+      if (drawBar(ch, level))
+         changed=1;
+   }
+
+   if (step)
+      gblSparkColumn=gblSparkColumn==SPARK_COLUMNS-1?0:gblSparkColumn+1;
+
+   if (changed)
+      triggerScreenUpdate();
+}
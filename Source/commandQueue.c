@@ -0,0 +1,333 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Deferred commands from the i2c interrupt to main()
+//
+//  ssp_interrupt() never touches the lcd bus and never formats text. It
+//  only decodes the i2c bytes and queues the work here, runCommands() in
+//  main() then carries it out. The queue is a single producer (interrupt)
+//  single consumer (main) ring: only the interrupt writes gblCmdHead and
+//  only main() writes gblCmdTail, so no locking is needed.
+//
+//  Characters received from the master are normally written straight
+//  into curText by storeChar(). While commands are still waiting in the
+//  queue they are queued too, so everything reaches the screen in the
+//  order the master sent it.
+//
+//  WRITE_REGION bytes take the same way through regionChar(), but their
+//  dirty bits are only set by endRegion(), all at once with one mask.
+//
+//  The MSSP holds SCL low after every byte it receives (SEN). The i2c
+//  interrupt lets the master go on with releaseClock() once the byte is
+//  handled, or leaves the clock held while the queue has less room than
+//  the next byte may take (gblQueueNeed), until runCommands() has made
+//  room. A byte normally queues one command at most, the last argument
+//  of DISPLAY_VALUE two (queueValue()) and of DISPLAY_SHORT_TEXT four
+//  characters. So the master can send at full
+//  bus speed and nothing is lost.
+//
+//  Frames: between BEGIN_FRAME and COMMIT_FRAME updateScreen() draws
+//  nothing. curText is then the back buffer the master builds the next
+//  frame in, while the lcd itself still shows the last complete one.
+//  COMMIT_FRAME hands all the dirty cells of the frame to updateScreen()
+//  at once by clearing gblFrameOpen. A BEGIN_FRAME that arrives while the
+//  previous frame is still being drawn holds the clock (HOLD_FRAME) until
+//  updateScreen() has finished it, so the lcd only ever shows whole frames.
+//
+//  A frame whose COMMIT_FRAME got lost is committed by the next
+//  BEGIN_FRAME, or after FRAME_TIMEOUT by runCommands(), so the screen
+//  cannot freeze for good.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define CMD_QUEUE_SIZE 8     // must be a power of 2
+#define CMD_QUEUE_MASK (CMD_QUEUE_SIZE-1)
+
+// queued operations
+#define OP_CHAR     0     // pos = where, arg = character
+#define OP_VALUE    1     // pos = where, arg = high byte of the value to show in decimal
+#define OP_CLEAR    2
+#define OP_SHOWCUR  3
+#define OP_HIDECUR  4
+#define OP_ERROR    5     // pos = error code, arg = data
+#define OP_COMMIT   6     // the frame is complete
+#define OP_DDRAM    7     // pos = DDRAM address off the screen, arg = character
+#define OP_MARQUEE_PAD 8  // pos = line, arg = first column to blank
+#define OP_SCROLL   9     // pos = display shift (see marquee.c)
+#define OP_VALUE_LOW 10   // arg = low byte, always right after OP_VALUE
+
+// reasons for holding SCL (gblClockHeld)
+#define HOLD_QUEUE  0x01  // the queue is full, runCommands() releases it
+#define HOLD_FRAME  0x02  // the previous frame is still drawn, updateScreen() releases it
+
+#define FRAME_TIMEOUT 610  // Timer0 ticks (0.5 sec) a frame may stay open
+
+int gblCmdOp[CMD_QUEUE_SIZE];
+int gblCmdPos[CMD_QUEUE_SIZE];
+int gblCmdArg[CMD_QUEUE_SIZE];
+
+int gblCmdHead=0;        // next free slot (written by the i2c interrupt only)
+int gblCmdTail=0;        // next command to run (written by main() only)
+int gblCmdOverflows=0;   // commands lost because the queue was full
+int gblClockHeld=0;      // HOLD_xxx: SCL is held until all of them are gone
+int gblQueueNeed=1;      // free slots the next byte from the master may take
+int1 gblFrameOpen=0;     // a frame is being built, updateScreen() waits
+int1 gblCommitQueued=0;  // OP_COMMIT is in the queue
+int16 gblFrameStart;     // Timer0 tick at which the frame was opened
+
+int gblRegionStart=0;    // WRITE_REGION: first position
+int gblRegionPos=0;      // WRITE_REGION: where the next byte goes
+
+
+// free slots in the queue
+#define queueRoom()  ((gblCmdTail-gblCmdHead-1) & CMD_QUEUE_MASK)
+
+
+// called from the i2c interrupt
+void queueCommand(int op, int pos, int arg) {
+   int head, next;
+
+   head=gblCmdHead;
+   next=(head+1) & CMD_QUEUE_MASK;
+   if (next == gblCmdTail) {
+      gblCmdOverflows++;
+      return;
+   }
+
+   gblCmdOp[head]=op;
+   gblCmdPos[head]=pos;
+   gblCmdArg[head]=arg;
+   gblCmdHead=next;   // publish the command last
+}
+
+
+// called from the i2c interrupt. Both halves are queued or neither, so
+// runCommands() always finds the low byte behind OP_VALUE
+void queueValue(int pos, int16 value) {
+   if (queueRoom() < 2) {
+      gblCmdOverflows++;
+      return;
+   }
+   queueCommand(OP_VALUE, pos, make8(value, 1));
+   queueCommand(OP_VALUE_LOW, 0, make8(value, 0));
+}
+
+
+// called from the i2c interrupt
+void storeChar(int pos, char c) {
+   if (gblCmdHead == gblCmdTail) {
+      curText[pos]=c;
+      setDirty(pos);
+   } else {
+      queueCommand(OP_CHAR, pos, c);   // keep the order of the queued commands
+   }
+}
+
+
+// called from the i2c interrupt: store a character at the input cursor
+void putChar(char c) {
+   storeChar(inputCursor, c);
+   inputCursor=inputCursor==LCD_CELLS-1?0:inputCursor+1;  // wrap position if need be
+}
+
+
+// called from the i2c interrupt: a WRITE_REGION payload starts at pos
+void regionStart(int pos) {
+   if (pos > LCD_CELLS)
+      pos=LCD_CELLS;     // off the screen, nothing will be stored
+   gblRegionStart=pos;
+   gblRegionPos=gblRegionStart;
+}
+
+
+// called from the i2c interrupt: next byte of a WRITE_REGION payload.
+// Any value is a character here, NUL included. The region ends at the
+// end of the screen, bytes beyond it are dropped.
+void regionChar(char c) {
+   if (gblRegionPos >= LCD_CELLS)
+      return;
+
+   if (gblCmdHead == gblCmdTail)
+      curText[gblRegionPos]=c;
+   else
+      queueCommand(OP_CHAR, gblRegionPos, c);   // keep the order of the queued commands
+   gblRegionPos++;
+}
+
+
+// called from the i2c interrupt when the region is complete (or the
+// master gave up on it): marks the received characters dirty in one go
+void endRegion() {
+   int n;
+
+   n=gblRegionPos-gblRegionStart;
+   if (n == 0)
+      return;
+
+   setDirtyRange(gblRegionStart, n);
+
+   inputCursor=gblRegionPos==LCD_CELLS?0:gblRegionPos;
+   triggerScreenUpdate();
+}
+
+
+// called from the i2c interrupt after each byte written by the master
+void releaseClock() {
+   if (queueRoom() < gblQueueNeed)
+      gblClockHeld|=HOLD_QUEUE;    // runCommands() releases it
+   if (gblClockHeld == 0)
+      CKP=1;
+}
+
+
+// called from main() with the interrupts off
+void releaseHold(int reason) {
+   if (gblClockHeld & reason) {
+      gblClockHeld&=~reason;
+      if (gblClockHeld == 0)
+         CKP=1;
+   }
+}
+
+
+// called from the i2c interrupt: COMMIT_FRAME
+void commitFrame() {
+   if (gblCmdHead == gblCmdTail) {
+      gblFrameOpen=0;
+      triggerScreenUpdate();
+   } else {
+      // the frame is complete once its queued commands have run
+      queueCommand(OP_COMMIT, 0, 0);
+      gblCommitQueued=1;
+   }
+}
+
+
+// called from the i2c interrupt: BEGIN_FRAME
+void beginFrame() {
+   // a frame still open has lost its COMMIT_FRAME, it is complete now
+   if (gblFrameOpen && !gblCommitQueued)
+      commitFrame();
+
+   if (gblFrameOpen || gblDirtyGroups != 0) {
+      // the previous frame has not reached the lcd yet
+      gblClockHeld|=HOLD_FRAME;
+      triggerScreenUpdate();
+   } else {
+      gblFrameOpen=1;
+      gblFrameStart=gblAdcTicks;
+   }
+}
+
+
+// called from main() by updateScreen() once the screen is clean,
+// with the interrupts off
+void openHeldFrame() {
+   if (gblClockHeld & HOLD_FRAME) {
+      gblFrameOpen=1;
+      gblFrameStart=gblAdcTicks;
+      releaseHold(HOLD_FRAME);
+   }
+}
+
+
+// called from the i2c interrupt
+void reportError(int errCode, int data) {
+   if (DEBUG_ON)
+      queueCommand(OP_ERROR, errCode, data);
+}
+
+
+void runCommands() {
+   int t, pos, i, n;
+   char digits[5];
+   int1 changed=0;
+
+   // the master has gone quiet in the middle of a frame
+   if (gblFrameOpen && !gblCommitQueued) {
+      disable_interrupts(GLOBAL);
+      if (gblFrameOpen && !gblCommitQueued && gblAdcTicks-gblFrameStart >= FRAME_TIMEOUT) {
+         gblFrameOpen=0;
+         changed=1;
+      }
+      enable_interrupts(GLOBAL);
+   }
+
+   while (gblCmdTail != gblCmdHead) {
+      t=gblCmdTail;
+      pos=gblCmdPos[t];
+
+      // the blanks queued before it go out first, and nothing goes out
+      // while a frame is built (see marquee.c)
+      if (gblCmdOp[t] == OP_DDRAM && !marqueeReady())
+         break;
+
+      switch (gblCmdOp[t]) {
+         case OP_CHAR:
+            curText[pos]=gblCmdArg[t];
+            setDirty(pos);
+            changed=1;
+            break;
+
+         case OP_VALUE:
+            // the low byte is in the queue too, its slot is freed next
+            n=formatDecimal(make16(gblCmdArg[t], gblCmdArg[(t+1) & CMD_QUEUE_MASK]), digits, 0, 0);
+            for (i=0;i<n;i++) {
+               curText[pos]=digits[i];
+               setDirty(pos);
+               pos=pos==LCD_CELLS-1?0:pos+1;
+            }
+            changed=1;
+            break;
+
+         case OP_CLEAR:
+            clearScreen();
+            marqueeClear();
+            break;
+
+         case OP_DDRAM:
+            marqueeWrite(pos, gblCmdArg[t], 1);
+            break;
+
+         case OP_MARQUEE_PAD:
+            if (marqueePad(pos, gblCmdArg[t]))
+               changed=1;
+            break;
+
+         case OP_SCROLL:
+            scrollTo(pos);
+            break;
+
+         case OP_SHOWCUR:
+            showCursor();
+            break;
+
+         case OP_HIDECUR:
+            hideCursor();
+            break;
+
+         case OP_ERROR:
+            showError(pos, gblCmdArg[t]);
+            break;
+
+         case OP_COMMIT:
+            gblFrameOpen=0;
+            gblCommitQueued=0;
+            changed=1;
+            break;
+      }
+
+      // free the slot only now: until then the interrupt keeps queueing
+      // characters instead of writing them under our feet
+      gblCmdTail=(t+1) & CMD_QUEUE_MASK;
+
+      if (gblClockHeld) {
+         disable_interrupts(GLOBAL);
+         if (queueRoom() >= gblQueueNeed)
+            releaseHold(HOLD_QUEUE);  // there is room for the next byte now
+         enable_interrupts(GLOBAL);
+      }
+   }
+
+   if (changed)
+      triggerScreenUpdate();
+}
@@ -0,0 +1,70 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  int16 to decimal text without divisions
+//
+//  n = formatDecimal( value, buffer, digits, flags )
+//      Writes value as decimal text into buffer (no NUL terminator is
+//      added) and returns the number of characters written.
+//      digits - minimum number of digits (0-5). Unused leading positions
+//               are padded with spaces, or zeros with FMT_ZERO_PAD.
+//               0 writes just as many digits as needed (like "%Lu")
+//      flags  - FMT_ZERO_PAD, and FMT_POINT(n) to put a decimal point
+//               before the last n digits (n = 1-4)
+//
+//  Each digit is found by subtracting its power of ten, at most 9 times,
+//  so a conversion costs a fixed handful of 16 bit subtractions instead
+//  of sprintf() or chains of / and % (@DIV1616). It is short enough to
+//  run inside the i2c interrupt.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define FMT_ZERO_PAD    0x80
+#define FMT_POINT(n)    (n)
+#define FMT_POINT_MASK  0x07
+
+const int16 FMT_POWERS[4] = {10000, 1000, 100, 10};
+
+
+int formatDecimal(int16 value, char *buffer, int digits, int flags) {
+   int n, p, point, digit;
+   int16 power;
+   char pad;
+   int1 leading=1;
+
+   point=flags & FMT_POINT_MASK;   // digits after the decimal point
+   if (digits < point+1)
+      digits=point+1;
+
+   if (flags & FMT_ZERO_PAD)
+      pad='0';
+   else
+      pad=' ';
+
+   n=0;
+   for (p=5; p!=0; p--) {   // p = position of the digit counted from the right
+      if (p > 1) {
+         power=FMT_POWERS[5-p];
+         digit=0;
+         while (value >= power) {
+            value-=power;
+            digit++;
+         }
+      } else {
+         digit=value;
+      }
+
+      if (digit != 0 || p <= point+1)
+         leading=0;
+
+      if (!leading) {
+         buffer[n++]=digit+'0';
+      } else if (p <= digits) {
+         buffer[n++]=pad;
+      }
+
+      if (point != 0 && p == point+1)
+         buffer[n++]='.';
+   }
+
+   return(n);
+}
@@ -0,0 +1,83 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Panel geometry and dirty character tracking
+//
+//  LCD_GEOMETRY (set in PCB.c) selects the panel at compile time. The
+//  screen buffer curText holds the cells row after row, cell number
+//  LCD_CELL(row, column). LCD_ROW_ADDR[] is the DDRAM address each row
+//  starts at.
+//
+//  Every cell has a dirty bit in gblDirtyCells[], 8 cells per byte, and
+//  every byte of gblDirtyCells[] has a bit in gblDirtyGroups. updateScreen()
+//  only scans the groups with dirty cells in them, so an update costs in
+//  proportion to the cells that changed, not to the size of the panel.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define LCD_16X2  0
+#define LCD_20X4  1
+#define LCD_40X2  2
+
+#if LCD_GEOMETRY == LCD_16X2
+#define LCD_COLS  16
+#define LCD_ROWS  2
+const int LCD_ROW_ADDR[LCD_ROWS] = {0x00, 0x40};
+
+#elif LCD_GEOMETRY == LCD_20X4
+#define LCD_COLS  20
+#define LCD_ROWS  4
+const int LCD_ROW_ADDR[LCD_ROWS] = {0x00, 0x40, 0x14, 0x54};
+
+#elif LCD_GEOMETRY == LCD_40X2
+#define LCD_COLS  40
+#define LCD_ROWS  2
+const int LCD_ROW_ADDR[LCD_ROWS] = {0x00, 0x40};
+
+#else
+#error unknown LCD_GEOMETRY
+#endif
+
+#define LCD_CELLS           (LCD_COLS*LCD_ROWS)
+#define LCD_CELL(row, col)  ((row)*LCD_COLS+(col))
+#define LCD_DIRTY_BYTES     ((LCD_CELLS+7)/8)
+
+#if LCD_DIRTY_BYTES > 16
+#error the panel has too many cells for gblDirtyGroups
+#endif
+
+int gblDirtyCells[LCD_DIRTY_BYTES];   // one bit per cell
+int16 gblDirtyGroups=0;               // one bit per byte of gblDirtyCells
+
+
+#inline
+void setDirty(int pos) {
+   bit_set(gblDirtyCells[pos >> 3], pos & 7);
+   bit_set(gblDirtyGroups, pos >> 3);
+}
+
+
+// n cells from pos, a whole byte of dirty bits at a time
+void setDirtyRange(int pos, int n) {
+   int k, first, mask;
+
+   while (n != 0) {
+      first=pos & 7;
+      k=8-first;
+      if (k > n) k=n;
+      mask=(0xFF >> (8-k)) << first;
+
+      gblDirtyCells[pos >> 3] |= mask;
+      bit_set(gblDirtyGroups, pos >> 3);
+      pos+=k;
+      n-=k;
+   }
+}
+
+
+void setAllDirty() {
+   int i;
+
+   for (i=0;i<LCD_DIRTY_BYTES;i++)
+      gblDirtyCells[i]=0xFF;
+   gblDirtyGroups=0xFFFF >> (16-LCD_DIRTY_BYTES);
+}
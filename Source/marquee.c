@@ -0,0 +1,253 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Lines longer than the panel, scrolled by the lcd itself
+//
+//  In two line mode the HD44780 keeps 40 characters per line in its DDRAM,
+//  the panel only shows LCD_COLS of them. MARQUEE_TEXT sets a whole line:
+//  its first LCD_COLS characters are the screen cells in curText as usual,
+//  the rest go straight to the off-screen DDRAM columns (OP_DDRAM, written
+//  by main()). The line is padded with blanks up to column 40, so a
+//  shorter text does not leave the end of an older one behind.
+//
+//  Scrolling moves the lcd's window over the 40 columns with the display
+//  shift instruction: one lcd command per step, whatever the size of the
+//  panel, and no character has to be redrawn. Both lines move together
+//  and the DDRAM is circular, so column 0 follows column 39. The screen
+//  cells stay where they are in the DDRAM, i.e. they scroll along.
+//
+//    0x48  R/W  scroll period in 26.2 msec steps (32 Timer0 ticks), one
+//               column to the left per step. 0 = not scrolling
+//    0x49  R/W  display shift, the column shown at the left edge (0-39)
+//
+//  The lcd work is done by marqueeTick() in main(). runCommands() only
+//  writes the characters of MARQUEE_TEXT, once the blanks queued before
+//  them are out. As soon as the window has moved, the off-screen columns
+//  are on the screen, so none of this reaches the lcd while the master
+//  builds a frame (see commandQueue.c): CLEAR's blanks and return home,
+//  the shift and the scroll steps wait for COMMIT_FRAME. Unless the queue
+//  fills up behind them: the clock would be held for good, so they are
+//  written anyway.
+//
+//  The rows of 4 line panels share the DDRAM lines with each other, so
+//  they have no off-screen columns and cannot scroll. MARQUEE_TEXT then
+//  only sets the screen cells.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#if LCD_ROWS == 2
+#define MARQUEE_COLS     40   // DDRAM columns per line
+#define MARQUEE_SCROLLS  1
+#else
+#define MARQUEE_COLS     LCD_COLS
+#define MARQUEE_SCROLLS  0
+#endif
+
+#define MARQUEE_TICK_SHIFT  5   // 32 Timer0 ticks per unit of gblScrollPeriod
+
+int gblMarqueeRow=LCD_ROWS;   // MARQUEE_TEXT: line being written, LCD_ROWS = none
+int gblMarqueeCol=0;          // MARQUEE_TEXT: where the next byte goes
+
+int gblScrollPeriod=0;        // register 0x48
+int gblScrollTarget=0;        // register 0x49, the shift wanted (written by main() only)
+int gblScrollShift=0;         // display shift on the lcd (main() only)
+int16 gblScrollLast=0;        // Timer0 tick of the last step
+int1 gblMarqueeUsed=1;        // off-screen columns or shift may not be blank / 0
+int1 gblMarqueeHome=0;        // CLEAR: return home instead of shifting back
+
+int gblMarqueeBlank[LCD_ROWS];   // off-screen columns of a line still to be
+                                 // blanked from here on, MARQUEE_COLS = none
+int1 gblMarqueePending=0;        // some gblMarqueeBlank[] is not MARQUEE_COLS
+
+// the lcd may be written to: no frame is being built, or its commit is
+// queued, or the queue is full and waits for the marquee
+#define marqueeMayWrite()  (!gblFrameOpen || gblCommitQueued || (gblClockHeld & HOLD_QUEUE))
+
+
+// called from the i2c interrupt: MARQUEE_TEXT sets line row to the n
+// characters that follow
+void marqueeStart(int row, int n) {
+   if (row >= LCD_ROWS) {
+      gblMarqueeRow=LCD_ROWS;   // no such line, nothing will be stored
+      return;
+   }
+   gblMarqueeRow=row;
+   gblMarqueeCol=0;
+
+   // blanked first, the text is queued behind it
+   if (n < MARQUEE_COLS)
+      queueCommand(OP_MARQUEE_PAD, row, n);
+}
+
+
+// called from the i2c interrupt: next character of MARQUEE_TEXT.
+// Characters beyond column 40 are dropped.
+void marqueeChar(char c) {
+   int pos;
+
+   if (gblMarqueeRow >= LCD_ROWS || gblMarqueeCol >= MARQUEE_COLS)
+      return;
+
+   // storeChar() done here, it would cost a stack level
+   if (gblMarqueeCol < LCD_COLS) {
+      pos=LCD_CELL(gblMarqueeRow, gblMarqueeCol);
+      if (gblCmdHead == gblCmdTail) {
+         curText[pos]=c;
+         setDirty(pos);
+      } else {
+         queueCommand(OP_CHAR, pos, c);
+      }
+   } else
+      queueCommand(OP_DDRAM, LCD_ROW_ADDR[gblMarqueeRow]+gblMarqueeCol, c);
+   gblMarqueeCol++;
+}
+
+
+// called from the i2c interrupt: register 0x49
+void scrollSelect(int shift) {
+   if (MARQUEE_SCROLLS && shift < MARQUEE_COLS)
+      queueCommand(OP_SCROLL, shift, 0);
+}
+
+
+void lcdInstruction(int code) {
+   waitLCDReady();
+   output_low(PIN_RS);
+   output_b(code);
+   submit();
+}
+
+
+// n characters c from DDRAM address addr, off the screen. The lcd cursor
+// ends up outside the screen cells. The lcd is driven directly instead of
+// through lcdInstruction() and type(), to save two stack levels.
+void marqueeWrite(int addr, char c, int n) {
+   if (c == '\0') c=' ';
+
+   waitLCDReady();
+   output_low(PIN_RS);
+   output_b(0x80 | addr);
+   submit();
+
+   while (n-- != 0) {
+      waitLCDReady();
+      output_high(PIN_RS);
+      output_b(c);
+      submit();
+      output_low(PIN_RS);
+      statCount(gblStatChars);
+   }
+   gblDisplayModuleCursorPos = LCD_POS_UNKNOWN;
+   gblMarqueeUsed=1;
+}
+
+
+// called from runCommands(): OP_SCROLL, marqueeTick() moves the window
+void scrollTo(int shift) {
+   gblScrollTarget=shift;
+}
+
+
+// called from runCommands(): OP_DDRAM may be written now
+int1 marqueeReady() {
+   return(!gblMarqueePending && marqueeMayWrite());
+}
+
+
+// blank a line from column col on. The screen cells are blanked at once,
+// the off-screen columns by marqueeTick(). Returns 1 when screen cells
+// changed.
+int1 marqueePad(int row, int col) {
+   int1 changed=0;
+
+   for (; col < LCD_COLS; col++) {
+      curText[LCD_CELL(row, col)]=' ';
+      setDirty(LCD_CELL(row, col));
+      changed=1;
+   }
+   if (col < gblMarqueeBlank[row]) {
+      gblMarqueeBlank[row]=col;
+      gblMarqueePending=1;
+   }
+   return(changed);
+}
+
+
+// blanks the off-screen columns and returns the window to column 0,
+// both done by marqueeTick()
+void marqueeClear() {
+   int row;
+
+   if (!gblMarqueeUsed)
+      return;
+
+   for (row=0;row<LCD_ROWS;row++)
+      gblMarqueeBlank[row]=LCD_COLS;
+   gblMarqueePending=(LCD_COLS < MARQUEE_COLS);
+   gblScrollTarget=0;
+   gblMarqueeHome=1;
+   gblMarqueeUsed=0;
+}
+
+
+// called from main(): writes the blanks, takes the scroll steps and moves
+// the window to gblScrollTarget. The lcd is driven from here and not
+// through helpers, to keep main() three stack levels deep at most.
+void marqueeTick() {
+   int row, n;
+   int16 now;
+
+   if (!marqueeMayWrite())
+      return;
+
+   if (gblMarqueePending) {
+      gblMarqueePending=0;
+      for (row=0;row<LCD_ROWS;row++) {
+         n=gblMarqueeBlank[row];
+         gblMarqueeBlank[row]=MARQUEE_COLS;
+         if (n < MARQUEE_COLS)
+            marqueeWrite(LCD_ROW_ADDR[row]+n, ' ', MARQUEE_COLS-n);
+      }
+   }
+
+   // one step every gblScrollPeriod units. Read once, the master may
+   // stop the scrolling meanwhile
+   n=gblScrollPeriod;
+   if (MARQUEE_SCROLLS && n != 0) {
+      disable_interrupts(GLOBAL);   // the Timer0 interrupt updates it
+      now=gblAdcTicks;
+      enable_interrupts(GLOBAL);
+      if (now-gblScrollLast >= ((int16)n << MARQUEE_TICK_SHIFT)) {
+         gblScrollLast=now;
+         gblScrollTarget=gblScrollTarget==MARQUEE_COLS-1?0:gblScrollTarget+1;
+      }
+   }
+
+   if (gblScrollTarget == gblScrollShift) {
+      gblMarqueeHome=0;
+      return;
+   }
+
+   if (gblScrollTarget == 0 && gblMarqueeHome) {
+      lcdInstruction(0x02);      // return home, the DDRAM is left alone
+#if !LCD_BUSY_FLAG
+      delay_ms(2);               // 1.52 msec instead of the usual 37 usec
+#endif
+      gblDisplayModuleCursorPos = LCD_POS_UNKNOWN;
+   } else {
+      // the shorter way round
+      n=gblScrollTarget+MARQUEE_COLS-gblScrollShift;
+      if (n >= MARQUEE_COLS) n-=MARQUEE_COLS;
+
+      if (n <= MARQUEE_COLS/2) {
+         while (n-- != 0)
+            lcdInstruction(0x18);   // display shift left
+      } else {
+         for (n=MARQUEE_COLS-n; n!=0; n--)
+            lcdInstruction(0x1C);   // display shift right
+      }
+   }
+   gblMarqueeHome=0;
+   gblScrollShift=gblScrollTarget;
+   if (gblScrollShift != 0)
+      gblMarqueeUsed=1;
+}
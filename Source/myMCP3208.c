@@ -8,15 +8,30 @@
 ////      0 through 7 and select                              ////
 ////      differential (0) or                                 ////
 ////      single (1) mode                                    ////
+////      The result is right aligned (0..4095)               ////
 ////                                                   ////
 ////  value = read_analog( channel )                           ////
 ////      Read an analog channel                              ////
 ////      0 through 7 in   single mode                           ////
 ////                                                   ////
+////  n = read_analog_scan( mask, diff_mask, values )            ////
+////      Read every channel whose bit is set in mask,         ////
+////      lowest first, into values[0..n-1]. Channels          ////
+////      also set in diff_mask are read in                    ////
+////      differential mode                                    ////
+////                                                   ////
+////  In differential mode the channel number selects the      ////
+////  pair: 0 = CH0+/CH1-, 1 = CH0-/CH1+, 2 = CH2+/CH3-, ...   ////
+////                                                   ////
 ////  convert_to_volts( value,  string )                        ////
 ////      Fills in string with                              ////
 ////      the true voltage in                                 ////
-////      the form 0.000                                    ////
+////      the form 0.000 (needs formatDecimal.c)             ////
+////                                                   ////
+////  The SPI clock is bit-banged as fast as the #use delay clock      ////
+////  allows. Extra delay cycles are only compiled in when the PIC     ////
+////  would otherwise violate the MCP3208 datasheet timing (define     ////
+////  MCP3208_VDD_2V7 when the converter runs from 2.7V).              ////
 ////                                                   ////
 ////////////////////////////////////////////////////////////////////////////
 ////        (C) Copyright 1996,2003 Custom Computer Services            ////
@@ -38,89 +53,110 @@
 
 //#endif
 
+#define MCP3208_VREF_MV  5000    // reference voltage used by convert_to_volts()
+
+
+// Datasheet timing limits in ns (MCP3208 DS21298, electrical characteristics)
+#ifdef MCP3208_VDD_2V7
+#define MCP3208_T_HILO_NS  500   // clock high / low time (fCLK max 1 MHz)
+#else
+#define MCP3208_T_HILO_NS  250   // clock high / low time (fCLK max 2 MHz)
+#endif
+#define MCP3208_T_CSH_NS   500   // CS disable time between conversions
+#define MCP3208_T_MAX_BIT_NS 100000 // fCLK min 10 kHz, slower clocks let the S/H droop
+
+// Instruction cycle time for the #use delay clock.
+#define MCP3208_TCY_NS     (4000000 / (getenv("CLOCK") / 1000))
+#define MCP3208_CYCLES(ns) (((ns) + MCP3208_TCY_NS - 1) / MCP3208_TCY_NS)
+
+// Minimum number of instruction cycles mcp3208_xfer() already spends
+// in each clock phase, and between raising CS and the next conversion.
+#define MCP3208_HIGH_OVERHEAD 3
+#define MCP3208_LOW_OVERHEAD  5
+#define MCP3208_CSH_OVERHEAD  3
+#define MCP3208_BIT_MAX_CYCLES 16
+
+#if MCP3208_CYCLES(MCP3208_T_HILO_NS) > MCP3208_HIGH_OVERHEAD
+#define mcp3208_high_delay() delay_cycles(MCP3208_CYCLES(MCP3208_T_HILO_NS) - MCP3208_HIGH_OVERHEAD)
+#else
+#define mcp3208_high_delay()
+#endif
+
+#if MCP3208_CYCLES(MCP3208_T_HILO_NS) > MCP3208_LOW_OVERHEAD
+#define mcp3208_low_delay() delay_cycles(MCP3208_CYCLES(MCP3208_T_HILO_NS) - MCP3208_LOW_OVERHEAD)
+#else
+#define mcp3208_low_delay()
+#endif
+
+#if MCP3208_CYCLES(MCP3208_T_CSH_NS) > MCP3208_CSH_OVERHEAD
+#define mcp3208_csh_delay() delay_cycles(MCP3208_CYCLES(MCP3208_T_CSH_NS) - MCP3208_CSH_OVERHEAD)
+#else
+#define mcp3208_csh_delay()
+#endif
+
+#if (MCP3208_TCY_NS * MCP3208_BIT_MAX_CYCLES) > MCP3208_T_MAX_BIT_NS
+#error MCP3208: the #use delay clock is too slow to keep fCLK above 10 kHz
+#endif
+
 
 
 void adc_init() {
    output_high(MCP3208_CS);
+   output_low(MCP3208_CLK);
+   output_drive(MCP3208_CLK);
 }
 
 
-void write_adc_byte(BYTE data_byte, BYTE number_of_bits) {
+// Clock one byte in and out of the converter, MSB first (SPI mode 0,0).
+// DIN is latched by the MCP3208 on the rising edge, DOUT changes on the
+// falling edge and is sampled here while the clock is high.
+BYTE mcp3208_xfer(BYTE data) {
    BYTE i;
 
-   delay_us(2);
-   for(i=0; i<number_of_bits; ++i) {
-      output_low(MCP3208_CLK);
-      if((data_byte & 1)==0)
-         output_low(MCP3208_DIN);
-      else
-         output_high(MCP3208_DIN);
-      data_byte=data_byte>>1;
-      delay_us(50);
+   for(i=0; i<8; ++i) {
+      output_bit(MCP3208_DIN, bit_test(data, 7));
       output_high(MCP3208_CLK);
-      delay_us(50);
-   }
-}
-
-
-BYTE read_adc_byte(BYTE number_of_bits) {
-   BYTE i,data;
-
-   data=0;
-   for(i=0;i<number_of_bits;++i) {
+      mcp3208_high_delay();
+      shift_left(&data, 1, input(MCP3208_DOUT));
       output_low(MCP3208_CLK);
-      delay_us(50);
-      shift_left(&data,1,input(MCP3208_DOUT));
-      output_high(MCP3208_CLK);
-      delay_us(50);
+      mcp3208_low_delay();
    }
    return(data);
 }
 
 
-long int read_analog_mcp(BYTE channel, BYTE mode) {
-   int l;
-   long int h;
-   BYTE ctrl_bits;
+// One conversion is a single 24 clock frame:
+//
+//    DIN   0 0 0 0 0 1 S D2 | D1 D0 x x x x x x | x x x x x x x x
+//    DOUT  ? ? ? ? ? ? ? ?  | ? ? ? 0 B11..B8   | B7 .. B0
+//
+// The first two DIN bytes for each channel, indexed by (single << 3) | channel
+const BYTE MCP3208_CTRL1[16] = {0x04,0x04,0x04,0x04,0x05,0x05,0x05,0x05,    // differential
+                                0x06,0x06,0x06,0x06,0x07,0x07,0x07,0x07};   // single ended
+const BYTE MCP3208_CTRL2[8]  = {0x00,0x40,0x80,0xC0,0x00,0x40,0x80,0xC0};
 
-   delay_us(200);
 
-   if(mode!=0)
-      mode=1;
+long int mcp3208_convert(BYTE index) {
+   BYTE h, l;
 
-   output_low(MCP3208_CLK);
-   output_high(MCP3208_DIN);
    output_low(MCP3208_CS);
 
-   if(channel==1)               // Change so MSB of channel #
-      ctrl_bits=4;            //      is in LSB place
-   else if(channel==3)
-      ctrl_bits=6;
-   else if(channel==4)
-      ctrl_bits=1;
-   else if(channel==6)
-      ctrl_bits=3;
-   else
-      ctrl_bits=channel;
-
-   ctrl_bits=ctrl_bits<<1;
+   mcp3208_xfer(MCP3208_CTRL1[index]);           // start bit, mode, D2
+   h=mcp3208_xfer(MCP3208_CTRL2[index & 0x07]);  // D1 D0 -> null bit, B11..B8
+   l=mcp3208_xfer(0);                            // B7..B0
 
-   if(mode==1)                  // In single mode
-      ctrl_bits |= 1;
-   else                        // In differential mode
-      ctrl_bits &= 0xfe;
-
-   ctrl_bits=ctrl_bits<<1;      // Shift so LSB is start bit
-   ctrl_bits |= 1;
+   output_high(MCP3208_CS);
+   mcp3208_csh_delay();
 
-   write_adc_byte( ctrl_bits, 7);   // Send the control bits
+   return(make16(h & 0x0F, l));
+}
 
-   h=read_adc_byte(8);
-   l=read_adc_byte(4)<<4;
 
-   output_high(MCP3208_CS);
+long int read_analog_mcp(BYTE channel, BYTE mode) {
+   if(mode!=0)
+      channel |= 0x08;        // In single mode
 
-   return((h<<8)|l);
+   return mcp3208_convert(channel & 0x0F);
 }
 
 
@@ -130,22 +166,26 @@ long int read_analog( BYTE channel )   // Auto specifies single mode
 }
 
 
-void convert_to_volts( long int data, char volts[6]) {
-   BYTE i, d, div_h, div_l;
-   long int temp,div;
-
-   div=0x3330;
-
-   for(i=0;i<=4;i++) {
-     temp=data/div;
-     volts[i]=(BYTE)temp+'0';
-     if(i==0) {
-       volts[1]='.';
-       i++;
-     }
-     temp=div*(BYTE)temp;
-     data=data-temp;
-     div=div/10;
+BYTE read_analog_scan(BYTE mask, BYTE diff_mask, long int *values) {
+   BYTE ch, n, index;
+
+   n=0;
+   for(ch=0; mask!=0; ch++, mask>>=1, diff_mask>>=1) {
+      if(bit_test(mask, 0)) {
+         index=ch;
+         if(!bit_test(diff_mask, 0))
+            index |= 0x08;     // single ended
+         values[n++]=mcp3208_convert(index);
+      }
    }
-   volts[i]='\0';
+   return(n);
+}
+
+
+void convert_to_volts( long int data, char volts[6]) {
+   long int mv;
+
+   mv=((int32)data * MCP3208_VREF_MV) >> 12;
+   formatDecimal(mv, volts, 4, FMT_ZERO_PAD | FMT_POINT(3));
+   volts[5]='\0';
 }
@@ -0,0 +1,334 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  i2c protocol engine, generated from protocol.def
+//
+//  ssp_interrupt() passes every byte the master writes to protocolByte().
+//  The command byte is looked up once in the table built from
+//  protocol.def, the fixed arguments are collected in gblCmdArgs[], and
+//  then the handlers of the command run from one switch on its code. The
+//  decoding works the same way for every command. A new command is one
+//  line in protocol.def and a handler here.
+//
+//  Every handler is called from a single place, so they are all inlined
+//  and the i2c interrupt keeps its shallow call stack.
+//
+//  General call: the module also answers i2c address 0, so one
+//  transaction reaches every module on the bus. Its first byte is
+//  (group << 1) | 1, the i2c "hardware general call" form, which other
+//  devices ignore. Group 0 is every module, groups 1-127 only the modules
+//  whose group register (0x4A) is set to it. The command follows as
+//  usual, but only the commands marked bcast in protocol.def are carried
+//  out, anything else is skipped up to the end of the transaction.
+//
+////////////////////////////////////////////////////////////////////////////
+
+// command codes
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd)  name=code,
+enum {
+#include <protocol.def>
+   PROTOCOL_CODES_END
+};
+#undef PROTOCOL_COMMAND
+
+// missing handlers
+#define NO_START()
+#define NO_BYTE(c)
+#define NO_END()
+
+#define CMD_MAX_ARGS 4
+
+int gblCmd=0;              // command being received
+int gblCmdFormat=0;        // its payload kind (high nibble) and argument count
+int gblArgCount=0;         // arguments received so far
+int gblCmdArgs[CMD_MAX_ARGS];
+int gblPayloadLeft=0;      // PAYLOAD_LENGTH bytes still to come
+
+#define cmdNumArgs()    (gblCmdFormat & 0x07)
+#define cmdBroadcast()  bit_test(gblCmdFormat, 3)
+#define cmdPayload()    (gblCmdFormat >> 4)
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//   Command handlers (see protocol.def)
+//
+//////////////////////////////////////////////////////////////////////////
+
+#inline
+void cmdValue() {
+   int16 value;
+   int n;
+
+   value=make16(gblCmdArgs[0], gblCmdArgs[1]);
+
+   // main() converts the value to text. Here we only work out
+   // how many digits it has to move the input cursor past them.
+   queueValue(inputCursor, value);
+
+   n=1;
+   if (value >= 10)    n++;
+   if (value >= 100)   n++;
+   if (value >= 1000)  n++;
+   if (value >= 10000) n++;
+   inputCursor+=n;
+   if (inputCursor >= LCD_CELLS) inputCursor-=LCD_CELLS;  // wrap position if need be
+}
+
+
+// 4 character text. This is here just to provide compatibility with
+// the 7-segment display module
+#inline
+void cmdShortText() {
+   int i;
+
+   for (i=0;i<4;i++)
+      putChar(gblCmdArgs[i]);
+   triggerScreenUpdate();
+}
+
+
+// sensor value from the gogo board
+#inline
+void cmdSensor() {
+   int sensorPort;
+
+   sensorPort = gblCmdArgs[0] >> 5;   // the 3 MSBs are the sensor port ID
+
+   // combine the two bytes into one 16 bit sensor value
+   // and store the sensor value in a global buffer
+   gblSensorValues[sensorPort] = make16(gblCmdArgs[0] & 0b00000011, gblCmdArgs[1]);
+
+   gblSensorTimeout = 0;  // reset the time-out counter
+
+   // We fill in the sensors that were not sent with
+   // the default value (1023). This is done to reduce
+   // the i2c traffic.
+   if (sensorPort <= gblLastSensorReceived) {
+      fillBlankSensorsWithDefaultValue();
+      gblUpdatedSensors = 0;
+   }
+   gblLastSensorReceived = sensorPort;
+
+   // record the updated sensor so we know the ones that
+   // were not updated. Used in fillDefaultSensorValue()
+   bit_set(gblUpdatedSensors, sensorPort);
+}
+
+
+#inline
+void cmdSensorFrame() {
+   sensorFrameStart(gblCmdArgs[0]);
+}
+
+
+#inline
+void cmdMarquee() {
+   marqueeStart(gblCmdArgs[0], gblCmdArgs[1]);
+}
+
+
+#inline
+void cmdSync() {
+   adcSync(make16(gblCmdArgs[0], gblCmdArgs[1]));
+}
+
+
+#inline
+void cmdClear() {
+   inputCursor=0;
+   queueCommand(OP_CLEAR, 0, 0);
+}
+
+
+#inline
+void cmdSetPos() {
+   int pos;
+
+   pos=gblCmdArgs[0];
+   if (pos>0) pos--;  // make the position a 1's based (first position is 1 not 0)
+   if (pos>=LCD_CELLS) pos=0;
+   inputCursor=pos;
+}
+
+
+#inline
+void cmdHideCursor() {
+   queueCommand(OP_HIDECUR, 0, 0);
+}
+
+
+#inline
+void cmdShowCursor() {
+   queueCommand(OP_SHOWCUR, 0, 0);
+}
+
+
+#inline
+void cmdRegSelect() {
+   gblRegPointer=gblCmdArgs[0];
+}
+
+
+// a register write has no length, it simply ends with the transaction
+#inline
+void cmdRegWrite(int value) {
+   regWrite(gblRegPointer++, value);
+}
+
+
+#inline
+void cmdGetStats() {
+   gblRegPointer=REG_STATS;
+}
+
+
+#inline
+void cmdRegion() {
+   regionStart(gblCmdArgs[0]);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//   Dispatch
+//
+//////////////////////////////////////////////////////////////////////////
+
+// payload kind << 4 | bcast << 3 | argument count, 0xFF for an unknown
+// command
+#inline
+int cmdFormat(int c) {
+   switch (c) {
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd) \
+      case code: return((payload << 4) | (bcast << 3) | nargs);
+#include <protocol.def>
+#undef PROTOCOL_COMMAND
+   }
+   return(0xFF);
+}
+
+
+// the payload is over (or the master has given up on it)
+void cmdFinish() {
+   slaveState=WAIT_ADDRESS;
+
+   switch (gblCmd) {
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd) \
+      case code: onEnd(); break;
+#include <protocol.def>
+#undef PROTOCOL_COMMAND
+   }
+}
+
+
+// called from the i2c interrupt with every byte the master writes
+#inline
+void protocolByte(int input) {
+   switch (slaveState) {
+      case WAIT_GROUP:
+         // general call: is it meant for this module?
+         slaveState=CMD_SKIP;
+         if (bit_test(input, 0)) {
+            input>>=1;
+            if (input == 0 || input == gblGroup)
+               slaveState=WAIT_CMD;
+         }
+         return;
+
+      case WAIT_CMD:
+         gblCmd=input;
+         gblCmdFormat=cmdFormat(input);
+         if (gblCmdFormat == 0xFF) {
+            reportError(ERR_UNKNOWN_COMMAND, input);
+            statCount(gblStatUnknownCmd);
+            slaveState=WAIT_ADDRESS;
+            return;
+         }
+         if (gblBroadcast && !cmdBroadcast()) {
+            slaveState=CMD_SKIP;
+            return;
+         }
+
+         gblReadRegisters = (input == REG_ACCESS || input == GET_STATS);
+         gblReadStream = (input == STREAM);
+         if (gblReadStream)
+            streamRestart();
+
+         // their last argument queues 2 commands, or 4 characters
+         if (input == DISPLAY_VALUE)
+            gblQueueNeed=2;
+         if (input == DISPLAY_SHORT_TEXT)
+            gblQueueNeed=4;
+         gblArgCount=0;
+         slaveState=CMD_ARGS;
+         if (cmdNumArgs() != 0)
+            return;
+         break;
+
+      case CMD_ARGS:
+         gblCmdArgs[gblArgCount++]=input;
+         if (gblArgCount != cmdNumArgs())
+            return;
+         break;
+
+      case CMD_PAYLOAD:
+         if (cmdPayload() == PAYLOAD_NUL && input == '\0') {
+            cmdFinish();
+            return;
+         }
+
+         switch (gblCmd) {
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd) \
+            case code: onByte(input); break;
+#include <protocol.def>
+#undef PROTOCOL_COMMAND
+         }
+
+         if (cmdPayload() == PAYLOAD_LENGTH && --gblPayloadLeft == 0)
+            cmdFinish();
+         return;
+
+      case CMD_SKIP:
+         return;
+
+      default:
+         reportError(ERR_UNKNOWN_STATE, slaveState);
+         slaveState=WAIT_ADDRESS;
+         return;
+   }
+
+   // all the arguments are in: run the command
+   gblQueueNeed=1;
+   slaveState=WAIT_ADDRESS;
+   if (cmdPayload() != PAYLOAD_NONE)
+      slaveState=CMD_PAYLOAD;
+   if (cmdPayload() == PAYLOAD_LENGTH)
+      gblPayloadLeft=gblCmdArgs[cmdNumArgs()-1];
+
+   switch (gblCmd) {
+#define PROTOCOL_COMMAND(name, code, nargs, payload, bcast, onStart, onByte, onEnd) \
+      case code: onStart(); break;
+#include <protocol.def>
+#undef PROTOCOL_COMMAND
+   }
+
+   if (cmdPayload() == PAYLOAD_LENGTH && gblPayloadLeft == 0)
+      cmdFinish();
+}
+
+
+// called from the i2c interrupt when the master starts a transaction.
+// A payload running up to the end of the transaction is complete now,
+// any other unfinished command was cut short: returns 0 then.
+int1 protocolEnd() {
+   int1 complete;
+
+   complete=(slaveState == WAIT_ADDRESS || slaveState == CMD_SKIP);
+   if (slaveState == CMD_PAYLOAD) {
+      complete=(cmdPayload() == PAYLOAD_OPEN);
+      cmdFinish();   // shows what did arrive
+   }
+   slaveState=WAIT_ADDRESS;
+   gblQueueNeed=1;
+   return(complete);
+}
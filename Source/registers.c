@@ -0,0 +1,230 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Flat register map used by the REG_ACCESS i2c command
+//
+//  The master writes REG_ACCESS followed by a start address. Any further
+//  bytes in the same transaction are written to consecutive registers.
+//  Reading (after a repeated start, or in a later transaction) returns
+//  consecutive registers from the current address, like a serial EEPROM.
+//  The address wraps at 0xFF.
+//
+//    0x00-0x1F  R/W  first 32 cells of the screen buffer (curText). Writes
+//                    mark the character dirty and trigger a screen update
+//    0x20-0x2F  R    latest ADC sample of channel 0-7, high byte first.
+//                    12 bits, 13-14 with FILTER_OVERSAMPLE (see adcFilter.c)
+//    0x30-0x3F  R/W  ADC sample period of channel 0-7 in Timer0 ticks
+//                    (819.2 usec), high byte first. 0 = channel off. At
+//                    most 4 channels are on (ADC_SLOTS, see adcScheduler.c),
+//                    another one stays off and reads 0
+//    0x40       R    status (see REG_STATUS_xxx)
+//    0x41       R/W  input cursor position
+//    0x42       R    ADC ring buffer overflows (wraps at 255)
+//    0x43       R    ADC conversions missed by the scheduler (wraps at 255)
+//    0x44       R/W  view mode (VIEW_TEXT, VIEW_ADC, VIEW_BARS)
+//    0x45       R/W  ADC channels read in differential mode (bit mask)
+//    0x46       R    ADC channels that changed by more than their deadband.
+//                    Reading it clears the mask and releases PIN_INT_OUT
+//    0x47       R/W  ADC channels watched for changes (bit mask)
+//    0x48       R/W  scroll period in 26.2 msec steps, 0 = off (see marquee.c)
+//    0x49       R/W  display shift, 0-39 (see marquee.c)
+//    0x4A       R/W  general call group, 1-127. 0 = none (see protocol.c)
+//    0x50-0x57  R/W  filter of ADC channel 0-7 (FILTER_xxx, see adcFilter.c)
+//    0x58-0x5F  R/W  deadband of ADC channel 0-7 in counts (see adcChange.c)
+//    0x60       R    i2c overruns (SSPOV). Writing 0x60 clears 0x60-0x65
+//    0x61       R    i2c write collisions (WCOL)
+//    0x62       R    transactions started in the wrong state
+//    0x63       R    unknown commands
+//    0x64       R    commands lost because the queue was full
+//    0x65       R    longest interrupt routine, in 3.2 usec Timer0 counts
+//    0x66-0x67  R    lcd characters drawn per second
+//    0x68-0x69  R    ADC conversions per second
+//                    (0x60-0x69 read 0xFF without STATS_ON, see stats.c)
+//
+//  16 bit registers are latched when their high byte is accessed, so the
+//  two bytes always belong to the same value. Unused addresses read 0xFF.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define REG_SCREEN      0x00
+#define REG_ADC         0x20
+#define REG_ADC_PERIOD  0x30
+#define REG_STATUS      0x40
+#define REG_CURSOR      0x41
+#define REG_ADC_OVERFLOWS 0x42
+#define REG_ADC_MISSED  0x43
+#define REG_VIEW        0x44
+#define REG_ADC_DIFF    0x45
+#define REG_ADC_CHANGED 0x46
+#define REG_ADC_WATCH   0x47
+#define REG_SCROLL_PERIOD 0x48
+#define REG_SCROLL_SHIFT  0x49
+#define REG_GROUP       0x4A
+#define REG_ADC_FILTER  0x50
+#define REG_ADC_DEADBAND 0x58
+#define REG_STATS       0x60
+#define REG_STAT_COLLISIONS  0x61
+#define REG_STAT_WRONG_STATE 0x62
+#define REG_STAT_UNKNOWN_CMD 0x63
+#define REG_STAT_CMD_LOST    0x64
+#define REG_STAT_ISR_MAX     0x65
+#define REG_STAT_CHARS       0x66
+#define REG_STAT_CONVERSIONS 0x68
+
+// REG_STATUS bits
+#define REG_STATUS_SCREEN_BUSY  0x01   // characters are waiting to be drawn
+#define REG_STATUS_ADC_OVERFLOW 0x02   // some ADC samples have been overwritten
+#define REG_STATUS_FRAME_OPEN   0x04   // BEGIN_FRAME without COMMIT_FRAME yet
+
+int16 gblRegLatch;   // holds a 16 bit register between its two byte accesses
+
+
+int regRead(int addr) {
+   int value;
+
+   if (addr < REG_ADC) {
+      return(curText[addr]);
+
+   } else if (addr < REG_ADC_PERIOD) {
+      if (!bit_test(addr, 0))
+         gblRegLatch=adcLatest((addr-REG_ADC) >> 1);
+
+   } else if (addr < REG_STATUS) {
+      if (!bit_test(addr, 0))
+         gblRegLatch=adcPeriod((addr-REG_ADC_PERIOD) >> 1);
+
+   } else if (addr >= REG_ADC_FILTER && addr < REG_ADC_FILTER+ADC_CHANNELS) {
+      return(gblFilterCfg[addr-REG_ADC_FILTER] & ~(1 << FILTER_PRIMED));
+
+   } else if (addr >= REG_ADC_DEADBAND && addr < REG_ADC_DEADBAND+ADC_CHANNELS) {
+      return(gblAdcDeadband[addr-REG_ADC_DEADBAND]);
+
+#if STATS_ON
+   } else if (addr >= REG_STAT_CHARS && addr < REG_STAT_CONVERSIONS+2) {
+      if (!bit_test(addr, 0)) {
+         if (addr == REG_STAT_CHARS)
+            gblRegLatch=gblStatCharsPerSec;
+         else
+            gblRegLatch=gblStatConvPerSec;
+      }
+#endif
+
+   } else {
+      switch (addr) {
+         case REG_STATUS:
+            value=0;
+            if (gblDirtyGroups != 0)  value |= REG_STATUS_SCREEN_BUSY;
+            if (gblAdcOverflows != 0) value |= REG_STATUS_ADC_OVERFLOW;
+            if (gblFrameOpen)         value |= REG_STATUS_FRAME_OPEN;
+            return(value);
+
+         case REG_CURSOR:
+            return(inputCursor);
+
+         case REG_ADC_OVERFLOWS:
+            return(gblAdcOverflows);
+
+         case REG_ADC_MISSED:
+            return(gblAdcMissed);
+
+         case REG_VIEW:
+            return(gblViewMode);
+
+         case REG_ADC_DIFF:
+            return(gblAdcDiffMask);
+
+         case REG_ADC_CHANGED:
+            return(adcTakeChanged());
+
+         case REG_ADC_WATCH:
+            return(gblAdcWatchMask);
+
+         case REG_SCROLL_PERIOD:
+            return(gblScrollPeriod);
+
+         case REG_SCROLL_SHIFT:
+            return(gblScrollTarget);
+
+         case REG_GROUP:
+            return(gblGroup);
+
+#if STATS_ON
+         case REG_STATS:
+            return(gblStatOverruns);
+
+         case REG_STAT_COLLISIONS:
+            return(gblStatCollisions);
+
+         case REG_STAT_WRONG_STATE:
+            return(gblStatWrongState);
+
+         case REG_STAT_UNKNOWN_CMD:
+            return(gblStatUnknownCmd);
+
+         case REG_STAT_CMD_LOST:
+            return(gblCmdOverflows);
+
+         case REG_STAT_ISR_MAX:
+            return(gblStatIsrMax);
+#endif
+
+         default:
+            return(0xFF);
+      }
+   }
+
+   // 16 bit registers
+   if (bit_test(addr, 0))
+      return(make8(gblRegLatch, 0));
+   return(make8(gblRegLatch, 1));
+}
+
+
+void regWrite(int addr, int value) {
+
+   if (addr < REG_ADC) {
+      storeChar(addr, value);
+      triggerScreenUpdate();
+
+   } else if (addr >= REG_ADC_PERIOD && addr < REG_STATUS) {
+      if (!bit_test(addr, 0))
+         gblRegLatch=make16(value, 0);
+      else
+         adcSetPeriod((addr-REG_ADC_PERIOD) >> 1, gblRegLatch | value);
+
+   } else if (addr == REG_CURSOR) {
+      if (value < LCD_CELLS)
+         inputCursor=value;
+
+   } else if (addr >= REG_ADC_FILTER && addr < REG_ADC_FILTER+ADC_CHANNELS) {
+      adcSetFilter(addr-REG_ADC_FILTER, value);
+
+   } else if (addr >= REG_ADC_DEADBAND && addr < REG_ADC_DEADBAND+ADC_CHANNELS) {
+      gblAdcDeadband[addr-REG_ADC_DEADBAND]=value;
+
+   } else if (addr == REG_ADC_WATCH) {
+      adcSetWatch(value);
+
+   } else if (addr == REG_STATS) {
+      statClear();
+      gblCmdOverflows=0;
+
+   } else if (addr == REG_SCROLL_PERIOD) {
+      if (MARQUEE_SCROLLS)
+         gblScrollPeriod=value;
+
+   } else if (addr == REG_SCROLL_SHIFT) {
+      scrollSelect(value);
+
+   } else if (addr == REG_GROUP) {
+      if (value < 0x80)
+         gblGroup=value;
+
+   } else if (addr == REG_ADC_DIFF) {
+      gblAdcDiffMask=value;
+
+   } else if (addr == REG_VIEW) {
+      gblViewMode=value;
+      gblViewChanged=1;    // main() redraws the labels
+   }
+   // everything else is read only
+}
@@ -0,0 +1,84 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  SENSOR_FRAME: all the gogo board sensors in one transaction
+//
+//  The command carries a mask of the sensors present (bit 0 = port 0) and
+//  the 10 bit values of those sensors, lowest port first, packed without
+//  gaps, most significant bit first:
+//
+//     byte 0   v0 bits 9-2
+//     byte 1   v0 bits 1-0, v1 bits 9-4
+//     byte 2   v1 bits 3-0, v2 bits 9-6
+//     ...      8 sensors take 10 bytes
+//
+//  The bytes are kept as they arrive and only unpacked into
+//  gblSensorValues[] once the whole frame is in, so a frame cut short
+//  changes nothing. Sensors missing from the mask get the default value
+//  1023, like the ones fillBlankSensorsWithDefaultValue() fills in for
+//  DISPLAY_UPDATE_SENSORS.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define SENSOR_PORTS         8
+#define SENSOR_PACKED_BYTES  10     // 8 sensors of 10 bits
+#define SENSOR_DEFAULT       1023
+
+int gblSensorPacked[SENSOR_PACKED_BYTES];
+int gblSensorFrameMask=0;     // sensors in the frame being received
+int gblSensorFrameBytes=0;    // bytes received so far
+
+
+// bytes taken by the sensors in mask
+int sensorPackedSize(int mask) {
+   int i, n;
+
+   n=0;
+   for (i=0;i<SENSOR_PORTS;i++) {
+      if (bit_test(mask, i))
+         n+=10;
+   }
+   return((n+7) >> 3);
+}
+
+
+// called from the i2c interrupt: a SENSOR_FRAME with the sensors in mask
+void sensorFrameStart(int mask) {
+   gblSensorFrameMask=mask;
+   gblSensorFrameBytes=0;
+}
+
+
+// called from the i2c interrupt with every payload byte
+void sensorFrameByte(int value) {
+   if (gblSensorFrameBytes < SENSOR_PACKED_BYTES)
+      gblSensorPacked[gblSensorFrameBytes]=value;
+   if (gblSensorFrameBytes != 0xFF)
+      gblSensorFrameBytes++;
+}
+
+
+// called from the i2c interrupt when the payload is over. A frame whose
+// length does not match its mask is dropped.
+void endSensorFrame() {
+   int i, k, at, shift;
+
+   if (gblSensorFrameBytes != sensorPackedSize(gblSensorFrameMask))
+      return;
+
+   // value k starts at bit 10*k: in byte k+k/4, 2*k%8 bits in
+   k=0;
+   for (i=0;i<SENSOR_PORTS;i++) {
+      if (!bit_test(gblSensorFrameMask, i)) {
+         gblSensorValues[i]=SENSOR_DEFAULT;
+         continue;
+      }
+      at=k+(k >> 2);
+      shift=6-((k << 1) & 7);
+      gblSensorValues[i]=(make16(gblSensorPacked[at], gblSensorPacked[at+1]) >> shift) & 0x3FF;
+      k++;
+   }
+
+   gblSensorTimeout=0;
+   gblUpdatedSensors=gblSensorFrameMask;
+   gblLastSensorReceived=SENSOR_PORTS-1;   // a DISPLAY_UPDATE_SENSORS starts a new round
+}
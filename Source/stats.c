@@ -0,0 +1,95 @@
+////////////////////////////////////////////////////////////////////////////
+//
+//  Performance and error counters, read by the master over i2c
+//  (registers 0x60-0x69, or the GET_STATS command)
+//
+//  The 8 bit counters wrap at 255 and are cleared by writing to 0x60.
+//  Rates are counted over one second (STATS_TICKS_PER_SEC Timer0 ticks)
+//  and then latched. The isr duration is the longest time from the first
+//  to the last line of an interrupt routine, in Timer0 counts of 3.2 usec
+//  (the CCS context save and restore are not included).
+//
+//  With STATS_ON set to 0 the counters and all the code updating them are
+//  compiled out, and the registers read 0xFF.
+//
+////////////////////////////////////////////////////////////////////////////
+
+#define STATS_TICKS_PER_SEC 1221   // Timer0 ticks (819.2 usec) in a second
+
+#if STATS_ON
+
+int gblStatOverruns=0;      // SSPOV found set, bytes from the master were lost
+int gblStatCollisions=0;    // WCOL found set
+int gblStatWrongState=0;    // transactions that started in the wrong state
+int gblStatUnknownCmd=0;    // unknown commands
+int gblStatIsrMax=0;        // longest interrupt routine in Timer0 counts
+int gblStatIsrStart;
+
+int16 gblStatChars=0;          // lcd characters this second (main() only)
+int16 gblStatConversions=0;    // conversions this second (Timer0 isr only)
+int16 gblStatCharsPerSec=0;
+int16 gblStatConvPerSec=0;
+int16 gblStatTicks=0;
+int1 gblStatSecond=0;          // tells main() to latch gblStatChars
+
+#define statCount(counter)   counter++
+#define statAdd(counter, n)  counter+=(n)
+#define statIsrBegin()       gblStatIsrStart=get_timer0()
+
+
+#inline
+void statIsrEnd() {
+   int t;
+
+   t=get_timer0()-gblStatIsrStart;
+   if (t > gblStatIsrMax)
+      gblStatIsrMax=t;
+}
+
+
+// called from the Timer0 interrupt
+#inline
+void statTick() {
+   if (++gblStatTicks < STATS_TICKS_PER_SEC)
+      return;
+
+   gblStatTicks=0;
+   gblStatConvPerSec=gblStatConversions;
+   gblStatConversions=0;
+   gblStatSecond=1;
+}
+
+
+// called from main()
+void statSecond() {
+   if (!gblStatSecond)
+      return;
+
+   gblStatSecond=0;
+   disable_interrupts(GLOBAL);   // the i2c interrupt may be reading it
+   gblStatCharsPerSec=gblStatChars;
+   enable_interrupts(GLOBAL);
+   gblStatChars=0;
+}
+
+
+// called from the i2c interrupt
+void statClear() {
+   gblStatOverruns=0;
+   gblStatCollisions=0;
+   gblStatWrongState=0;
+   gblStatUnknownCmd=0;
+   gblStatIsrMax=0;
+}
+
+#else
+
+#define statCount(counter)
+#define statAdd(counter, n)
+#define statIsrBegin()
+#define statIsrEnd()
+#define statTick()
+#define statSecond()
+#define statClear()
+
+#endif
@@ -0,0 +1,1068 @@
+// Static worst case timing of the interrupt routines, from the CCS output
+//
+//    isrtime [-c clock] [-v] config PCB.hex PCB.lst PCB.sym
+//
+// The code is decoded from PCB.hex (the listing leaves out the library
+// routines such as @PRINTF_LU_419 and @DIV1616). PCB.sym gives the entry
+// points, PCB.lst the source line of every instruction. The instruction
+// cycles of every path are added up (GOTO, CALL, RETURN, RETLW, RETFIE,
+// writes to PCL and taken skips take 2 cycles, the rest 1) and the
+// longest path of each interrupt routine is reported, from the interrupt
+// vector to RETFIE, called routines included.
+//
+// Loops need a bound. Counted loops (DECFSZ / INCFSZ of a register loaded
+// with MOVLW just before the loop) are bounded automatically, that covers
+// the delay loops and the division routines. The others are bounded in
+// the config file, which has one directive per line ('#' comments):
+//
+//    isr <name>                    analyze this interrupt routine
+//    branch <isr> "source text"    also report the longest path through
+//                                  the code after that source line (if
+//                                  this build has it)
+//    loop <function> "text" <n>    loops whose first or last instruction
+//                                  is on a source line containing text run
+//                                  at most n times. <function> is the
+//                                  routine analyzed or the one the loop's
+//                                  code belongs to (inlined library code),
+//                                  or *. "text" may be * for any loop
+//    cycles <function> <n>         use n cycles for a routine instead of
+//                                  analyzing it
+//    budget <isr> <kHz>            every path of the isr must fit in one
+//                                  i2c byte time (9 clocks) at this speed
+//
+// The report gives each routine and branch in cycles and usec, and
+// whether it fits in one byte time at 100 and 400 kHz. The exit status
+// is 1 when a budget is exceeded or a loop has no bound, 2 on errors.
+// -v also lists the loops and their bounds, and the loop and cycles
+// directives the code did not need.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#define CODE_SIZE    0x2000
+#define MAX_LINE     512
+#define MAX_NAMES    256
+#define MAX_DIRS     128
+#define MAX_EDGES    (4*CODE_SIZE)
+#define MAX_LOOPS    256
+#define EXIT_NODE    CODE_SIZE
+#define NO_PATH      (-1)
+
+#define REG_PCL      0x02
+#define REG_PCLATH   0x0A
+
+// decoded instructions
+enum { OP_OTHER, OP_GOTO, OP_CALL, OP_RETURN, OP_RETLW, OP_RETFIE, OP_SKIP,
+       OP_PCL_WRITE, OP_MOVLW, OP_MOVWF, OP_BSF, OP_BCF, OP_DECFSZ, OP_INCFSZ,
+       OP_CLRF };
+
+typedef struct {
+   int op;
+   int k;       // GOTO/CALL target (11 bits), literal, or register
+   int bit;     // BSF/BCF bit
+} Instr;
+
+typedef struct {
+   char name[64];
+   int addr;
+} Symbol;
+
+enum { DIR_ISR, DIR_BRANCH, DIR_LOOP, DIR_CYCLES, DIR_BUDGET };
+
+typedef struct {
+   int kind;
+   char name[64];
+   char text[128];
+   long n;
+   int used;
+} Directive;
+
+typedef struct {
+   int from, to;
+   int64_t cost;
+   int alive;
+} Edge;
+
+static uint16_t code[CODE_SIZE];
+static int programmed[CODE_SIZE];
+static Instr instr[CODE_SIZE];
+static int srcLine[CODE_SIZE];            // index into srcText, -1 for none
+static char **srcText;
+static int numSrc, maxSrc;
+static int *srcNext;                      // first instruction after each source line
+
+static Symbol symbols[MAX_NAMES];
+static int numSymbols;
+static Directive dirs[MAX_DIRS];
+static int numDirs;
+
+static int64_t wcet[CODE_SIZE];           // of called routines, -1 unknown, -2 busy
+static double cycleUs=0.2;                // 20 MHz
+static int verbose, unbounded;
+static const char *configName;
+
+
+static void fail(const char *file, int line, const char *what) {
+   if (line > 0)
+      fprintf(stderr, "%s:%d: %s\n", file, line, what);
+   else
+      fprintf(stderr, "%s: %s\n", file, what);
+   exit(2);
+}
+
+
+static const char *symbolName(int addr) {
+   static char buf[16];
+   int i;
+
+   for (i=0;i<numSymbols;i++) {
+      if (symbols[i].addr == addr)
+         return(symbols[i].name);
+   }
+   sprintf(buf, "%04X", addr);
+   return(buf);
+}
+
+
+static int symbolAddr(const char *name) {
+   int i;
+
+   for (i=0;i<numSymbols;i++) {
+      if (strcmp(symbols[i].name, name) == 0)
+         return(symbols[i].addr);
+   }
+   return(-1);
+}
+
+
+// the routine an address belongs to: the closest entry point below it
+static const char *routineOf(int addr) {
+   int i, best=-1;
+
+   for (i=0;i<numSymbols;i++) {
+      if (symbols[i].addr <= addr && (best < 0 || symbols[i].addr > symbols[best].addr))
+         best=i;
+   }
+   return(best < 0 ? "?" : symbols[best].name);
+}
+
+
+static const char *sourceOf(int addr) {
+   if (addr < 0 || addr >= CODE_SIZE || srcLine[addr] < 0)
+      return("");
+   return(srcText[srcLine[addr]]);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//   Input files
+//
+//////////////////////////////////////////////////////////////////////////
+
+static int hexValue(const char *p, int digits) {
+   char buf[9];
+
+   memcpy(buf, p, digits);
+   buf[digits]='\0';
+   return(strtol(buf, NULL, 16));
+}
+
+
+// INHX8M: byte addresses, words low byte first
+static void readHex(const char *name) {
+   char line[MAX_LINE];
+   int n, addr, type, i, lineNo=0, base=0;
+   FILE *f;
+
+   f=fopen(name, "r");
+   if (f == NULL)
+      fail(name, 0, "cannot open");
+
+   while (fgets(line, sizeof(line), f)) {
+      lineNo++;
+      if (line[0] != ':')
+         continue;
+      n=hexValue(line+1, 2);
+      addr=hexValue(line+3, 4);
+      type=hexValue(line+7, 2);
+      if ((int)strlen(line) < 11+2*n)
+         fail(name, lineNo, "short record");
+
+      if (type == 4) {
+         base=hexValue(line+9, 4) << 16;
+      } else if (type == 0) {
+         for (i=0;i<n;i++) {
+            int byteAddr=base+addr+i;
+            int word=byteAddr >> 1;
+
+            if (word >= CODE_SIZE)
+               continue;    // configuration words
+            if (byteAddr & 1)
+               code[word]|=hexValue(line+9+2*i, 2) << 8;
+            else
+               code[word]|=hexValue(line+9+2*i, 2);
+            programmed[word]=1;
+         }
+      }
+   }
+   fclose(f);
+}
+
+
+static void decode(void) {
+   int a, w, f, d;
+   Instr *in;
+
+   for (a=0;a<CODE_SIZE;a++) {
+      in=&instr[a];
+      w=code[a] & 0x3FFF;
+      in->op=OP_OTHER;
+      f=w & 0x7F;
+      d=(w >> 7) & 1;
+
+      if (w == 0x0008) {
+         in->op=OP_RETURN;
+      } else if (w == 0x0009) {
+         in->op=OP_RETFIE;
+      } else if ((w & 0x3F80) == 0x0080) {               // MOVWF
+         in->op=f == REG_PCL ? OP_PCL_WRITE : OP_MOVWF;
+         in->k=f;
+      } else if ((w & 0x3F80) == 0x0180) {               // CLRF
+         in->op=f == REG_PCL ? OP_PCL_WRITE : OP_CLRF;
+         in->k=f;
+      } else if ((w & 0x3000) == 0x0000) {               // byte oriented
+         switch ((w >> 8) & 0x0F) {
+            case 0x0B: in->op=OP_DECFSZ; break;
+            case 0x0F: in->op=OP_INCFSZ; break;
+         }
+         in->k=f;
+         if (d && f == REG_PCL)
+            in->op=OP_PCL_WRITE;
+      } else if ((w & 0x3000) == 0x1000) {               // bit oriented
+         in->k=f;
+         in->bit=(w >> 7) & 7;
+         switch ((w >> 10) & 3) {
+            case 0: in->op=OP_BCF; break;
+            case 1: in->op=OP_BSF; break;
+            default: in->op=OP_SKIP; break;
+         }
+      } else if ((w & 0x3800) == 0x2000) {
+         in->op=OP_CALL;
+         in->k=w & 0x7FF;
+      } else if ((w & 0x3800) == 0x2800) {
+         in->op=OP_GOTO;
+         in->k=w & 0x7FF;
+      } else if ((w & 0x3C00) == 0x3000) {
+         in->op=OP_MOVLW;
+         in->k=w & 0xFF;
+      } else if ((w & 0x3C00) == 0x3400) {
+         in->op=OP_RETLW;
+      }
+   }
+}
+
+
+static void addSource(const char *text) {
+   while (isspace((unsigned char)*text))
+      text++;
+   if (numSrc == maxSrc) {
+      maxSrc=maxSrc ? 2*maxSrc : 1024;
+      srcText=realloc(srcText, maxSrc*sizeof(char *));
+      srcNext=realloc(srcNext, maxSrc*sizeof(int));
+   }
+   srcText[numSrc]=strdup(text);
+   srcText[numSrc][strcspn(srcText[numSrc], "\r\n")]='\0';
+   srcNext[numSrc]=-1;
+   numSrc++;
+}
+
+
+// source lines are "....................  text", instructions "AAAA:  OP"
+static void readListing(const char *name) {
+   char line[MAX_LINE];
+   int addr, i, pending=0;
+   FILE *f;
+
+   for (i=0;i<CODE_SIZE;i++)
+      srcLine[i]=-1;
+
+   f=fopen(name, "r");
+   if (f == NULL)
+      fail(name, 0, "cannot open");
+
+   while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "....................", 20) == 0) {
+         addSource(line+20);
+         pending=1;
+      } else if (isxdigit((unsigned char)line[0]) && line[4] == ':'
+                 && sscanf(line, "%x:", &addr) == 1 && addr < CODE_SIZE) {
+         if (numSrc > 0) {
+            srcLine[addr]=numSrc-1;
+            // the source lines without code of their own lead here too
+            for (i=numSrc-1; pending && i >= 0 && srcNext[i] < 0; i--)
+               srcNext[i]=addr;
+         }
+         pending=0;
+      }
+   }
+   fclose(f);
+}
+
+
+static void readSymbols(const char *name) {
+   char line[MAX_LINE], sym[64];
+   int inRom=0, addr;
+   FILE *f;
+
+   f=fopen(name, "r");
+   if (f == NULL)
+      fail(name, 0, "cannot open");
+
+   while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "ROM Allocation:", 15) == 0) {
+         inRom=1;
+      } else if (inRom) {
+         if (sscanf(line, "%x %63s", &addr, sym) != 2)
+            break;
+         if (numSymbols < MAX_NAMES) {
+            strcpy(symbols[numSymbols].name, sym);
+            symbols[numSymbols].addr=addr;
+            numSymbols++;
+         }
+      }
+   }
+   fclose(f);
+   if (numSymbols == 0)
+      fail(name, 0, "no ROM Allocation");
+}
+
+
+// a word, or "quoted text", from *p
+static int token(char **p, char *out, int size) {
+   char *s=*p;
+   int n=0;
+
+   while (isspace((unsigned char)*s)) s++;
+   if (*s == '\0' || *s == '#')
+      return(0);
+   if (*s == '"') {
+      s++;
+      while (*s && *s != '"' && n < size-1)
+         out[n++]=*s++;
+      if (*s == '"') s++;
+   } else {
+      while (*s && !isspace((unsigned char)*s) && n < size-1)
+         out[n++]=*s++;
+   }
+   out[n]='\0';
+   *p=s;
+   return(1);
+}
+
+
+static void readConfig(const char *name) {
+   char line[MAX_LINE], word[128], *p;
+   Directive *dir;
+   int lineNo=0;
+   FILE *f;
+
+   f=fopen(name, "r");
+   if (f == NULL)
+      fail(name, 0, "cannot open");
+
+   while (fgets(line, sizeof(line), f)) {
+      lineNo++;
+      p=line;
+      if (!token(&p, word, sizeof(word)))
+         continue;
+      if (numDirs == MAX_DIRS)
+         fail(name, lineNo, "too many directives");
+      dir=&dirs[numDirs];
+      memset(dir, 0, sizeof(*dir));
+
+      if (strcmp(word, "isr") == 0)          dir->kind=DIR_ISR;
+      else if (strcmp(word, "branch") == 0)  dir->kind=DIR_BRANCH;
+      else if (strcmp(word, "loop") == 0)    dir->kind=DIR_LOOP;
+      else if (strcmp(word, "cycles") == 0)  dir->kind=DIR_CYCLES;
+      else if (strcmp(word, "budget") == 0)  dir->kind=DIR_BUDGET;
+      else fail(name, lineNo, "unknown directive");
+
+      if (!token(&p, dir->name, sizeof(dir->name)))
+         fail(name, lineNo, "missing name");
+      if (dir->kind == DIR_BRANCH || dir->kind == DIR_LOOP) {
+         if (!token(&p, dir->text, sizeof(dir->text)))
+            fail(name, lineNo, "missing source text");
+      }
+      if (dir->kind == DIR_LOOP || dir->kind == DIR_CYCLES || dir->kind == DIR_BUDGET) {
+         if (!token(&p, word, sizeof(word)) || atol(word) <= 0)
+            fail(name, lineNo, "missing number");
+         dir->n=atol(word);
+      }
+      if (dir->kind == DIR_BUDGET && symbolAddr(dir->name) < 0)
+         fail(name, lineNo, "no such routine in the symbol file");
+      if (dir->kind == DIR_ISR && symbolAddr(dir->name) < 0) {
+         printf("%s:%d: %s is not in this build\n", name, lineNo, dir->name);
+         continue;
+      }
+      numDirs++;
+   }
+   fclose(f);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//   Control flow
+//
+//////////////////////////////////////////////////////////////////////////
+
+// GOTO and CALL only hold 11 bits, the rest comes from PCLATH. CCS sets
+// PCLATH<4:3> just before a jump to another page, so look back a few
+// instructions for it, else assume the current page.
+static int jumpTarget(int pc) {
+   int page, a, seen3=0, seen4=0;
+
+   page=pc & 0x1800;
+   for (a=pc-1; a >= 0 && a >= pc-4; a--) {
+      if (instr[a].op == OP_GOTO || instr[a].op == OP_RETURN || instr[a].op == OP_RETLW)
+         break;
+      if ((instr[a].op == OP_BSF || instr[a].op == OP_BCF) && instr[a].k == REG_PCLATH) {
+         int mask=instr[a].bit == 3 ? 0x0800 : instr[a].bit == 4 ? 0x1000 : 0;
+
+         if ((mask == 0x0800 && seen3) || (mask == 0x1000 && seen4) || mask == 0)
+            continue;    // a later instruction already decided it
+         if (mask == 0x0800) seen3=1;
+         if (mask == 0x1000) seen4=1;
+         if (instr[a].op == OP_BSF) page|=mask; else page&=~mask;
+      }
+   }
+   return(page | instr[pc].k);
+}
+
+
+static int64_t routineCycles(int addr);
+
+typedef struct {
+   Edge edges[MAX_EDGES];
+   int numEdges;
+   int node[CODE_SIZE+1];       // reachable from the entry
+   int rep[CODE_SIZE+1];        // loop header a node was folded into
+   int terminal;                // see buildGraph()
+   int calls[MAX_NAMES];
+   int numCalls;
+} Graph;
+
+static Graph graph;
+
+
+static void addEdge(Graph *g, int from, int to, int64_t cost) {
+   if (g->numEdges == MAX_EDGES)
+      fail("isrtime", 0, "too many edges");
+   g->edges[g->numEdges].from=from;
+   g->edges[g->numEdges].to=to;
+   g->edges[g->numEdges].cost=cost;
+   g->edges[g->numEdges].alive=1;
+   g->numEdges++;
+}
+
+
+static void checkAddr(int from, int to) {
+   char msg[128];
+
+   if (to < 0 || to >= CODE_SIZE || !programmed[to]) {
+      sprintf(msg, "%04X (%s) jumps to unprogrammed %04X", from, routineOf(from), to);
+      fail("isrtime", 0, msg);
+   }
+}
+
+
+// Builds the graph of the code reachable from entry, the cycles of the
+// called routines folded into the CALL. Normally the routine ends at its
+// RETURN or RETFIE. With a terminal (>= 0) the only way out is reaching
+// the terminal instead, and the entry points of other routines are dead
+// ends: that is the path from the interrupt vector into one isr.
+static void buildGraph(Graph *g, int entry, int terminal) {
+   int *stack;
+   int sp=0, pc, to, a, i;
+   int64_t callee;
+   Instr *in;
+
+   g->numEdges=0;
+   g->numCalls=0;
+   g->terminal=terminal;
+   for (a=0;a<=CODE_SIZE;a++) {
+      g->node[a]=0;
+      g->rep[a]=a;
+   }
+   g->node[EXIT_NODE]=1;
+
+   stack=malloc(CODE_SIZE*sizeof(int));
+   if (stack == NULL)
+      fail("isrtime", 0, "out of memory");
+   checkAddr(entry, entry);
+   g->node[entry]=1;
+   stack[sp++]=entry;
+
+   while (sp > 0) {
+      pc=stack[--sp];
+      in=&instr[pc];
+
+      #define FOLLOW(target, cost) do {                     \
+         to=(target);                                        \
+         addEdge(g, pc, to, cost);                           \
+         if (to != EXIT_NODE && !g->node[to]) {              \
+            checkAddr(pc, to);                               \
+            g->node[to]=1;                                   \
+            stack[sp++]=to;                                  \
+         }                                                   \
+      } while (0)
+
+      if (terminal >= 0) {
+         if (pc == terminal) {
+            addEdge(g, pc, EXIT_NODE, 0);
+            continue;
+         }
+         if (pc != entry && symbolAddr(symbolName(pc)) == pc)
+            continue;    // another isr
+      }
+
+      switch (in->op) {
+         case OP_GOTO:
+            FOLLOW(jumpTarget(pc), 2);
+            break;
+
+         case OP_CALL:
+            to=jumpTarget(pc);
+            checkAddr(pc, to);
+            callee=routineCycles(to);
+            for (i=0;i<g->numCalls && g->calls[i] != to;i++) ;
+            if (i == g->numCalls && i < MAX_NAMES)
+               g->calls[g->numCalls++]=to;
+            FOLLOW(pc+1, 2+callee);
+            break;
+
+         case OP_RETURN:
+         case OP_RETLW:
+         case OP_RETFIE:
+            if (terminal < 0)
+               FOLLOW(EXIT_NODE, 2);
+            break;
+
+         case OP_SKIP:
+         case OP_DECFSZ:
+         case OP_INCFSZ:
+            FOLLOW(pc+1, 1);
+            FOLLOW(pc+2, 2);
+            break;
+
+         case OP_PCL_WRITE:
+            // a jump or RETLW table follows
+            for (a=pc+1; a < CODE_SIZE && (instr[a].op == OP_GOTO || instr[a].op == OP_RETLW); a++)
+               FOLLOW(a, 2);
+            if (a == pc+1) {
+               char msg[96];
+               sprintf(msg, "computed jump at %04X (%s) without a table", pc, routineOf(pc));
+               fail("isrtime", 0, msg);
+            }
+            break;
+
+         default:
+            FOLLOW(pc+1, 1);
+            break;
+      }
+      #undef FOLLOW
+   }
+   free(stack);
+}
+
+
+// the loop counter of a counted loop: the instruction before the back
+// edge is DECFSZ/INCFSZ f, and f was loaded with MOVLW k just before the
+// loop header
+static long countedBound(int header, int latch) {
+   int a, f, op;
+
+   if (latch < 1)
+      return(0);
+   op=instr[latch-1].op;
+   if (instr[latch].op != OP_GOTO || (op != OP_DECFSZ && op != OP_INCFSZ))
+      return(0);
+   f=instr[latch-1].k;
+
+   for (a=header-1; a >= 0 && a >= header-6; a--) {
+      if (instr[a].op == OP_GOTO || instr[a].op == OP_RETURN)
+         return(0);
+      if (instr[a].op == OP_MOVWF && instr[a].k == f && a > 0 && instr[a-1].op == OP_MOVLW) {
+         int k=instr[a-1].k;
+         if (op == OP_DECFSZ) return(k == 0 ? 256 : k);
+         return(256-k);
+      }
+   }
+   return(0);
+}
+
+
+static long configBound(int routine, int header, int latch) {
+   const char *name=symbolName(routine);
+   int i;
+
+   for (i=0;i<numDirs;i++) {
+      Directive *dir=&dirs[i];
+
+      if (dir->kind != DIR_LOOP)
+         continue;
+      if (strcmp(dir->name, "*") != 0 && strcmp(dir->name, name) != 0
+          && strcmp(dir->name, routineOf(header)) != 0)
+         continue;
+      if (strcmp(dir->text, "*") == 0 || strstr(sourceOf(header), dir->text)
+          || strstr(sourceOf(latch), dir->text)) {
+         dir->used=1;
+         return(dir->n);
+      }
+   }
+   return(0);
+}
+
+
+typedef struct {
+   int header;
+   int size;
+   long bound;
+} Loop;
+
+static int onStack[CODE_SIZE+1], visited[CODE_SIZE+1];
+static int isBackEdge[MAX_EDGES];
+
+
+static void findBackEdges(Graph *g, int n) {
+   int i;
+
+   visited[n]=1;
+   onStack[n]=1;
+   for (i=0;i<g->numEdges;i++) {
+      Edge *e=&g->edges[i];
+
+      if (!e->alive || e->from != n)
+         continue;
+      if (onStack[e->to])
+         isBackEdge[i]=1;
+      else if (!visited[e->to])
+         findBackEdges(g, e->to);
+   }
+   onStack[n]=0;
+}
+
+
+// nodes of the natural loop of header: they reach a latch without
+// passing the header
+static int loopBody(Graph *g, int header, char *inBody) {
+   static int work[CODE_SIZE+1];
+   int sp=0, i, n, size=1;
+
+   memset(inBody, 0, CODE_SIZE+1);
+   inBody[header]=1;
+   for (i=0;i<g->numEdges;i++) {
+      if (isBackEdge[i] && g->edges[i].to == header && !inBody[g->edges[i].from]) {
+         inBody[g->edges[i].from]=1;
+         work[sp++]=g->edges[i].from;
+         size++;
+      }
+   }
+   while (sp > 0) {
+      n=work[--sp];
+      for (i=0;i<g->numEdges;i++) {
+         Edge *e=&g->edges[i];
+
+         if (e->to == n && !inBody[e->from] && g->node[e->from]) {
+            inBody[e->from]=1;
+            work[sp++]=e->from;
+            size++;
+         }
+      }
+   }
+   return(size);
+}
+
+
+static int order[CODE_SIZE+1], numOrder;
+static int mark[CODE_SIZE+1];
+
+
+// reverse postorder of the alive edges below n, within the nodes in set
+// (all nodes when set is NULL); edges into stop are not followed
+static void topoVisit(Graph *g, int n, const char *set, int stop) {
+   int i;
+
+   mark[n]=1;
+   for (i=0;i<g->numEdges;i++) {
+      Edge *e=&g->edges[i];
+
+      if (!e->alive || e->from != n || e->to == stop)
+         continue;
+      if (set != NULL && !set[e->to])
+         continue;
+      if (mark[e->to] == 1) {
+         char msg[128];
+         sprintf(msg, "loop at %04X (%s) is not structured", e->to, routineOf(e->to));
+         fail("isrtime", 0, msg);
+      }
+      if (mark[e->to] == 0)
+         topoVisit(g, e->to, set, stop);
+   }
+   mark[n]=2;
+   order[numOrder++]=n;
+}
+
+
+// longest alive path from start to every node, -1 for unreachable
+static void longestFrom(Graph *g, int start, const char *set, int stop, int64_t *dist) {
+   int i, j, n;
+
+   memset(mark, 0, sizeof(mark));
+   numOrder=0;
+   topoVisit(g, start, set, stop);
+
+   for (i=0;i<=CODE_SIZE;i++)
+      dist[i]=NO_PATH;
+   dist[start]=0;
+   for (j=numOrder-1;j>=0;j--) {
+      n=order[j];
+      if (dist[n] == NO_PATH)
+         continue;
+      for (i=0;i<g->numEdges;i++) {
+         Edge *e=&g->edges[i];
+
+         if (!e->alive || e->from != n || e->to == stop)
+            continue;
+         if (set != NULL && !set[e->to])
+            continue;
+         if (dist[n]+e->cost > dist[e->to])
+            dist[e->to]=dist[n]+e->cost;
+      }
+   }
+}
+
+
+static int cmpLoops(const void *a, const void *b) {
+   return(((const Loop *)a)->size-((const Loop *)b)->size);
+}
+
+
+// folds every loop into its header, innermost first: the header gets
+// one edge to each place the loop can be left from, costing
+// (bound-1) iterations plus the longest way out
+static void foldLoops(Graph *g, int routine, int entry) {
+   static char inBody[CODE_SIZE+1];
+   static int64_t dist[CODE_SIZE+1], exitCost[CODE_SIZE+1];
+   static Loop loops[MAX_LOOPS];
+   int numLoops=0, i, j, h, latch;
+   int64_t iter;
+   long bound;
+
+   memset(visited, 0, sizeof(visited));
+   memset(onStack, 0, sizeof(onStack));
+   memset(isBackEdge, 0, sizeof(isBackEdge));
+   findBackEdges(g, entry);
+
+   for (i=0;i<g->numEdges;i++) {
+      if (!isBackEdge[i])
+         continue;
+      h=g->edges[i].to;
+      for (j=0;j<numLoops && loops[j].header != h;j++) ;
+      if (j < numLoops)
+         continue;
+      if (numLoops == MAX_LOOPS)
+         fail("isrtime", 0, "too many loops");
+      loops[numLoops].header=h;
+      loops[numLoops].size=loopBody(g, h, inBody);
+      numLoops++;
+   }
+   qsort(loops, numLoops, sizeof(Loop), cmpLoops);
+
+   for (j=0;j<numLoops;j++) {
+      h=loops[j].header;
+      loopBody(g, h, inBody);
+
+      // the loop's own bound: a counted loop or the config file
+      bound=0;
+      latch=-1;
+      for (i=0;i<g->numEdges;i++) {
+         if (isBackEdge[i] && g->edges[i].to == h) {
+            latch=g->edges[i].from;
+            if (bound == 0)
+               bound=countedBound(h, latch);
+         }
+      }
+      if (bound == 0)
+         bound=configBound(routine, h, latch);
+      if (bound == 0) {
+         printf("no bound for the loop at %04X in %s: %s\n", h, symbolName(routine),
+                *sourceOf(h) ? sourceOf(h) : "(no source)");
+         unbounded=1;
+         bound=1;
+      }
+      if (verbose)
+         printf("   loop %04X in %s, %ld times: %s\n", h, symbolName(routine), bound, sourceOf(h));
+
+      longestFrom(g, h, inBody, h, dist);
+
+      iter=0;
+      for (i=0;i<=CODE_SIZE;i++)
+         exitCost[i]=NO_PATH;
+      for (i=0;i<g->numEdges;i++) {
+         Edge *e=&g->edges[i];
+
+         if (!e->alive || !inBody[e->from] || dist[e->from] == NO_PATH)
+            continue;
+         if (e->to == h) {
+            if (dist[e->from]+e->cost > iter)
+               iter=dist[e->from]+e->cost;
+         } else if (!inBody[e->to]) {
+            if (dist[e->from]+e->cost > exitCost[e->to])
+               exitCost[e->to]=dist[e->from]+e->cost;
+         }
+      }
+
+      for (i=0;i<g->numEdges;i++) {
+         if (inBody[g->edges[i].from])
+            g->edges[i].alive=0;
+      }
+      for (i=0;i<=CODE_SIZE;i++) {
+         if (inBody[i] && i != h) {
+            g->node[i]=0;
+            g->rep[i]=h;
+         }
+         if (g->rep[i] != i && inBody[g->rep[i]])
+            g->rep[i]=h;
+      }
+      for (i=0;i<=CODE_SIZE;i++) {
+         if (exitCost[i] != NO_PATH)
+            addEdge(g, h, i, (bound-1)*iter+exitCost[i]);
+      }
+   }
+}
+
+
+static int64_t configCycles(int addr) {
+   const char *name=symbolName(addr);
+   int i;
+
+   for (i=0;i<numDirs;i++) {
+      if (dirs[i].kind == DIR_CYCLES && strcmp(dirs[i].name, name) == 0) {
+         dirs[i].used=1;
+         return(dirs[i].n);
+      }
+   }
+   return(-1);
+}
+
+
+// worst case cycles of a called routine, RETURN included
+static int64_t routineCycles(int addr) {
+   static int64_t dist[CODE_SIZE+1];
+   Graph *g;
+
+   if (wcet[addr] == -2) {
+      char msg[96];
+      sprintf(msg, "%s calls itself", symbolName(addr));
+      fail("isrtime", 0, msg);
+   }
+   if (wcet[addr] >= 0)
+      return(wcet[addr]);
+
+   wcet[addr]=configCycles(addr);
+   if (wcet[addr] >= 0)
+      return(wcet[addr]);
+
+   wcet[addr]=-2;
+   g=malloc(sizeof(Graph));
+   if (g == NULL)
+      fail("isrtime", 0, "out of memory");
+   buildGraph(g, addr, -1);
+   foldLoops(g, addr, addr);
+   longestFrom(g, addr, NULL, -1, dist);
+   wcet[addr]=dist[EXIT_NODE] == NO_PATH ? 0 : dist[EXIT_NODE];
+   free(g);
+   return(wcet[addr]);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+//   Report
+//
+//////////////////////////////////////////////////////////////////////////
+
+static double byteUs(int khz) {
+   return(9000.0/khz);
+}
+
+
+static void printTime(const char *what, int64_t cycles) {
+   double us=cycles*cycleUs;
+
+   printf("%-36s %7lld cycles %8.1f us   100 kHz %-4s  400 kHz %s\n", what, (long long)cycles, us,
+          us <= byteUs(100) ? "ok" : "OVER", us <= byteUs(400) ? "ok" : "OVER");
+}
+
+
+static int cmpCalls(const void *a, const void *b) {
+   int64_t x=wcet[*(const int *)a], y=wcet[*(const int *)b];
+   return(x < y ? 1 : x > y ? -1 : 0);
+}
+
+
+// the vector code at 0x0004 up to the jump into the isr: context save
+// and the flag tests of the isrs with a higher priority
+static int64_t vectorCycles(int entry) {
+   static int64_t dist[CODE_SIZE+1];
+
+   buildGraph(&graph, 0x0004, entry);
+   foldLoops(&graph, entry, 0x0004);
+   longestFrom(&graph, 0x0004, NULL, -1, dist);
+   return(dist[EXIT_NODE] == NO_PATH ? 0 : dist[EXIT_NODE]);
+}
+
+
+static int64_t isrTotal[MAX_DIRS];
+
+
+static int64_t analyzeIsr(Directive *isr) {
+   static int64_t from[CODE_SIZE+1], to[CODE_SIZE+1];
+   char label[160];
+   int entry, i, j, k, n, a;
+   int64_t vector, total, through, best;
+
+   entry=symbolAddr(isr->name);
+   vector=vectorCycles(entry);
+
+   buildGraph(&graph, entry, -1);
+   foldLoops(&graph, entry, entry);
+   longestFrom(&graph, entry, NULL, -1, from);
+   total=vector+(from[EXIT_NODE] == NO_PATH ? 0 : from[EXIT_NODE]);
+
+   // longest path from every node to the exit, on the reversed graph
+   for (i=0;i<=CODE_SIZE;i++)
+      to[i]=NO_PATH;
+   to[EXIT_NODE]=0;
+   for (j=0;j<numOrder;j++) {      // order[] is a postorder: successors first
+      n=order[j];
+      for (i=0;i<graph.numEdges;i++) {
+         Edge *e=&graph.edges[i];
+         if (e->alive && e->from == n && to[e->to] != NO_PATH && to[e->to]+e->cost > to[n])
+            to[n]=to[e->to]+e->cost;
+      }
+   }
+
+   sprintf(label, "%s", isr->name);
+   printTime(label, total);
+
+   for (k=0;k<numDirs;k++) {
+      if (dirs[k].kind != DIR_BRANCH || strcmp(dirs[k].name, isr->name) != 0)
+         continue;
+      best=NO_PATH;
+      for (i=0;i<numSrc;i++) {
+         if (!strstr(srcText[i], dirs[k].text) || srcNext[i] < 0)
+            continue;
+         a=graph.rep[srcNext[i]];
+         if (from[a] == NO_PATH || to[a] == NO_PATH)
+            continue;
+         through=vector+from[a]+to[a];
+         if (through > best)
+            best=through;
+      }
+      snprintf(label, sizeof(label), "   %s", dirs[k].text);
+      if (best == NO_PATH) {
+         if (verbose)
+            printf("%-36s not in this build\n", label);
+      } else
+         printTime(label, best);
+   }
+
+   qsort(graph.calls, graph.numCalls, sizeof(int), cmpCalls);
+   if (graph.numCalls > 0) {
+      printf("   calls:");
+      for (i=0;i<graph.numCalls;i++)
+         printf(" %s %lld", symbolName(graph.calls[i]), (long long)wcet[graph.calls[i]]);
+      printf("\n");
+   }
+   return(total);
+}
+
+
+int main(int argc, char **argv) {
+   int i, j, numFiles=0, over=0;
+   const char *files[4];
+   int64_t blocking;
+   double clock=20e6;
+
+   for (i=1;i<argc;i++) {
+      if (strcmp(argv[i], "-v") == 0)
+         verbose=1;
+      else if (strcmp(argv[i], "-c") == 0 && i+1 < argc)
+         clock=atof(argv[++i]);
+      else if (numFiles < 4)
+         files[numFiles++]=argv[i];
+      else
+         numFiles=5;
+   }
+   if (numFiles != 4 || clock <= 0) {
+      fprintf(stderr, "usage: isrtime [-c clock] [-v] config PCB.hex PCB.lst PCB.sym\n");
+      return(2);
+   }
+   cycleUs=4e6/clock;
+   configName=files[0];
+
+   readHex(files[1]);
+   decode();
+   readListing(files[2]);
+   readSymbols(files[3]);
+   readConfig(configName);
+   for (i=0;i<CODE_SIZE;i++)
+      wcet[i]=-1;
+
+   printf("worst case from the interrupt vector to RETFIE, one i2c byte is %.1f us at 100 kHz, %.1f us at 400 kHz\n\n",
+          byteUs(100), byteUs(400));
+
+   for (i=0;i<numDirs;i++) {
+      if (dirs[i].kind != DIR_ISR)
+         continue;
+      isrTotal[i]=analyzeIsr(&dirs[i]);
+      printf("\n");
+   }
+
+   // no interrupt nests on the 16F: one has to wait for the longest other
+   for (i=0;i<numDirs;i++) {
+      if (dirs[i].kind != DIR_BUDGET)
+         continue;
+      blocking=0;
+      for (j=0;j<numDirs;j++) {
+         if (dirs[j].kind == DIR_ISR && strcmp(dirs[j].name, dirs[i].name) != 0 && isrTotal[j] > blocking)
+            blocking=isrTotal[j];
+      }
+      for (j=0;j<numDirs;j++) {
+         double us;
+
+         if (dirs[j].kind != DIR_ISR || strcmp(dirs[j].name, dirs[i].name) != 0)
+            continue;
+         us=isrTotal[j]*cycleUs;
+         printf("budget %s at %ld kHz: %.1f us of %.1f us (%.1f us more when it waits for another isr): %s\n",
+                dirs[i].name, dirs[i].n, us, byteUs(dirs[i].n), blocking*cycleUs,
+                us <= byteUs(dirs[i].n) ? "ok" : "OVER");
+         if (us > byteUs(dirs[i].n))
+            over=1;
+      }
+   }
+
+   for (i=0;verbose && i<numDirs;i++) {
+      if ((dirs[i].kind == DIR_LOOP || dirs[i].kind == DIR_CYCLES) && !dirs[i].used)
+         printf("%s: %s %s \"%s\" was not used\n", configName,
+                dirs[i].kind == DIR_LOOP ? "loop" : "cycles", dirs[i].name, dirs[i].text);
+   }
+
+   return(over || unbounded);
+}